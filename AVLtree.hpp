@@ -5,172 +5,297 @@
 #include <utility>
 #include <iostream>
 #include <queue>
+#include <memory>
 
-#include "TreeBase.hpp"
+#include "SearchTree.hpp"
 #include "Node.hpp"
+#include "PoolAllocator.hpp"
+#include "TreeSet.hpp"
+#include "TreeMap.hpp"
+#include "JoinTree.hpp"
+
+/*
+AVL balancing over any kind of elements. AVLtree and AVLmap below
+are the set and the map built on it.
+*/
+template< class Value_t, class Key_t, class KeyOf_t, class Compare_t, class Allocator_t, bool Counted, class Aggregate_t >
+class AVLbase : public SearchTree<Node<Value_t, 2, Counted, Aggregate_t>, Key_t, KeyOf_t, Compare_t, Allocator_t> {
+protected:
+	// The balance factor (height of the right subtree minus the left one) is kept in two bits
+	typedef SearchTree<Node<Value_t, 2, Counted, Aggregate_t>, Key_t, KeyOf_t, Compare_t, Allocator_t> Base;
+	typedef typename Base::node_t node_t;
+	using Base::root;
+	using Base::comp;
+	using Base::alloc;
+	using Base::elems_num;
+	using Base::keyOf;
+	using Base::findNode;
 
-template< class Key_t, class Compare_t = std::less<Key_t> >
-class AVLtree : public TreeBase<Key_t, Compare_t> {
 private:
-	Node<Key_t> *root;
-	Compare_t comp;
-	int elems_num = 0;
+	static int getBalance(const node_t *node) {
+		// 0, 1, 3 stand for 0, 1, -1
+		return (int)(node->getTag() ^ 2) - 2;
+	}
 
-	Node<Key_t> *find(const Key_t &key) const {
-		if (root == nullptr)
-			return nullptr;
-		Node<Key_t> *node = root;
-		while (1) {
-			if (comp(key, node->data)) {
-				if (node->getLeft() == nullptr)
-					return nullptr;
-				node = node->getLeft();
+	static void setBalance(node_t *node, int balance) {
+		node->setTag(balance & 3);
+	}
+
+	/*
+	Restores the node which got the balance factor 2 or -2.
+	Returns the new root of the subtree and sets "shrunk" if its height has decreased.
+	*/
+	static node_t *balance(node_t *node, int b, bool &shrunk, node_t **tree_root) {
+		if (b == 2) {
+			node_t *right = node->getRight();
+			int rb = getBalance(right);
+			if (rb < 0) {
+				node_t *top = right->getLeft();
+				int tb = getBalance(top);
+				right->rotateRight(tree_root);
+				node->rotateLeft(tree_root);
+				setBalance(node, tb > 0 ? -1 : 0);
+				setBalance(right, tb < 0 ? 1 : 0);
+				setBalance(top, 0);
+				shrunk = true;
+				return top;
 			}
-			else if (comp(node->data, key)) {
-				if (node->getRight() == nullptr)
-					return nullptr;
-				node = node->getRight();
+			node->rotateLeft(tree_root);
+			setBalance(node, rb == 0 ? 1 : 0);
+			setBalance(right, rb == 0 ? -1 : 0);
+			shrunk = (rb != 0);
+			return right;
+		}
+		else {
+			node_t *left = node->getLeft();
+			int lb = getBalance(left);
+			if (lb > 0) {
+				node_t *top = left->getRight();
+				int tb = getBalance(top);
+				left->rotateLeft(tree_root);
+				node->rotateRight(tree_root);
+				setBalance(node, tb < 0 ? 1 : 0);
+				setBalance(left, tb > 0 ? -1 : 0);
+				setBalance(top, 0);
+				shrunk = true;
+				return top;
 			}
-			else
-				return node;
+			node->rotateRight(tree_root);
+			setBalance(node, lb == 0 ? -1 : 0);
+			setBalance(left, lb == 0 ? 1 : 0);
+			shrunk = (lb != 0);
+			return left;
 		}
 	}
 
-	static void balance(Node<Key_t> *node) {
-		int lh = (node->getLeft() != nullptr ? node->getLeft()->getHeight() : 0);
-		int rh = (node->getRight() != nullptr ? node->getRight()->getHeight() : 0);
-		if (lh - rh == 2) {
-			int llh = (node->getLeft()->getLeft() != nullptr ? node->getLeft()->getLeft()->getHeight() : 0);
-			int lrh = (node->getLeft()->getRight() != nullptr ? node->getLeft()->getRight()->getHeight() : 0);
-			if (lrh > llh) {
-				node->getLeft()->rotateLeft();
-				node->rotateRight();
+	/*
+	The subtree of "node" has grown by one. Returns whether the whole tree has grown.
+	After an insertion a rotation always gives the height back, after a join it may not.
+	*/
+	static bool fixInsertion(node_t *node, node_t **tree_root) {
+		for (node_t *p = node->getParent(); p != nullptr; node = p, p = p->getParent()) {
+			int b = getBalance(p) + (node == p->getLeft() ? -1 : 1);
+			if (b == 2 || b == -2) {
+				bool shrunk;
+				p = balance(p, b, shrunk, tree_root);
+				if (shrunk)
+					return false;
 			}
-			else
-				node->rotateRight();
-			return;
-		}
-		if (rh - lh == 2) {
-			int rrh = (node->getRight()->getRight() != nullptr ? node->getRight()->getRight()->getHeight() : 0);
-			int rlh = (node->getRight()->getLeft() != nullptr ? node->getRight()->getLeft()->getHeight() : 0);
-			if (rlh > rrh) {
-				node->getRight()->rotateRight();
-				node->rotateLeft();
+			else {
+				setBalance(p, b);
+				if (b == 0)
+					return false;
 			}
-			else
-				node->rotateLeft();
-			return;
 		}
+		return true;
 	}
 
-	void fix(Node<Key_t> *node) {
-		for (Node<Key_t> *p = node; p->getParent() != nullptr; p = p->getParent())
-			balance(p);
-		balance(root);
+	// One of the subtrees of "p" has shrunk by one
+	void fixDeletion(node_t *p, bool from_left) {
+		while (p != nullptr) {
+			int b = getBalance(p) + (from_left ? 1 : -1);
+			if (b == 2 || b == -2) {
+				bool shrunk;
+				p = balance(p, b, shrunk, &root);
+				if (!shrunk)
+					return;
+			}
+			else {
+				setBalance(p, b);
+				if (b != 0)
+					return;
+			}
+			from_left = p->isLeft();
+			p = p->getParent();
+		}
 	}
 
-public:
-	AVLtree() {
-		root = nullptr;
-		comp = Compare_t();
-	}
+	static int check_rec(const node_t *node) {
+		if (node == nullptr)
+			return 0;
+
+		int lh = check_rec(node->getLeft());
+		int rh = check_rec(node->getRight());
+		if (rh - lh != getBalance(node))
+			throw "Tree is incorrect!";
 
-	AVLtree(const Compare_t &comp) {
-		root = nullptr;
-		this->comp = comp;
+		return (lh > rh ? lh : rh) + 1;
 	}
 
-	~AVLtree() {
-		if (root != nullptr)
-			root->remove();
+	static int height(const node_t *node) {
+		int h = 0;
+		for (; node != nullptr; h++)
+			node = (getBalance(node) > 0 ? node->getRight() : node->getLeft());
+		return h;
 	}
 
-	void insert(const Key_t &key) {
+protected:
+	/*
+	Links the node made by "create" at the place of the key unless the key is already there.
+	Returns the node with the key and whether it is new.
+	*/
+	template< class Create_t >
+	std::pair<node_t*, bool> insertWith(const Key_t &key, Create_t create) {
 		if (root == nullptr) {
-			Node<Key_t>::createRoot(key, &root);
+			root = create();
 			elems_num++;
-			return;
+			return {root, true};
 		}
-		Node<Key_t> *node = root;
+		node_t *node = root;
 		while (1) {
-			if (comp(key, node->data)) {
+			if (comp(key, keyOf(node))) {
 				if (node->getLeft() == nullptr) {
-					node->createLeft(key);
+					node_t *new_node = create();
+					node->setLeft(new_node);
+					new_node->updateUp();
 					elems_num++;
-					fix(node);
-					return;
+					fixInsertion(new_node, &root);
+					return {new_node, true};
 				}
 				node = node->getLeft();
 			}
-			else if (comp(node->data, key)) {
+			else if (comp(keyOf(node), key)) {
 				if (node->getRight() == nullptr) {
-					node->createRight(key);
+					node_t *new_node = create();
+					node->setRight(new_node);
+					new_node->updateUp();
 					elems_num++;
-					fix(node);
-					return;
+					fixInsertion(new_node, &root);
+					return {new_node, true};
 				}
 				node = node->getRight();
 			}
 			else
-				return; // This key already exists
+				return {node, false}; // This key already exists
 		}
 	}
 
-	bool contains(const Key_t &key) const {
-		return !(find(key) == nullptr);
+	static void setBuiltTag(node_t *node, int lh, int rh, bool) {
+		setBalance(node, rh - lh);
 	}
 
-	void erase(const Key_t &key) {
-		Node<Key_t> *node = find(key);
+	// The rank used by joins is the height
+	static int rankOf(const node_t *tree) {
+		return height(tree);
+	}
+
+	// Takes a subtree of the root "node" of a tree with the given rank off, returns it with its rank
+	static node_t *cutChild(node_t *node, int rank, bool left, int &child_rank) {
+		int b = getBalance(node);
+		child_rank = rank - ((left ? b > 0 : b < 0) ? 2 : 1);
+		return (left ? node->cutLeft() : node->cutRight());
+	}
+
+	/*
+	Joins the trees "left" and "right" with the single node "middle" between them.
+	Goes down the side of the higher tree to the height of the other one, links the
+	node there and retraces up, so it takes O(|left_rank - right_rank| + 1).
+	*/
+	static node_t *joinNodes(node_t *left, int left_rank, node_t *middle, node_t *right, int right_rank, int &rank) {
+		if (left_rank > right_rank + 1) {
+			node_t *tree = left, *p = nullptr, *c = left;
+			int hc = left_rank;
+			while (hc > right_rank + 1) {
+				hc -= (getBalance(c) < 0 ? 2 : 1);
+				p = c;
+				c = c->getRight();
+			}
+			middle->setLeft(c);
+			middle->setRight(right);
+			setBalance(middle, right_rank - hc);
+			p->setRight(middle);
+			middle->updateUp();
+			rank = left_rank + fixInsertion(middle, &tree);
+			return tree;
+		}
+		if (right_rank > left_rank + 1) {
+			node_t *tree = right, *p = nullptr, *c = right;
+			int hc = right_rank;
+			while (hc > left_rank + 1) {
+				hc -= (getBalance(c) > 0 ? 2 : 1);
+				p = c;
+				c = c->getLeft();
+			}
+			middle->setLeft(left);
+			middle->setRight(c);
+			setBalance(middle, hc - left_rank);
+			p->setLeft(middle);
+			middle->updateUp();
+			rank = right_rank + fixInsertion(middle, &tree);
+			return tree;
+		}
+		middle->setLeft(left);
+		middle->setRight(right);
+		setBalance(middle, right_rank - left_rank);
+		middle->update();
+		rank = (left_rank > right_rank ? left_rank : right_rank) + 1;
+		return middle;
+	}
+
+	void eraseNode(node_t *node) {
 		if (node == nullptr)
 			return;
 
-		Node<Key_t> *n = node;
-		while (1) {
-				if (n->getRight() != nullptr) {
-					n = n->getRight();
-					while (n->getLeft() != nullptr)
-						n = n->getLeft();
-					std::swap(n->data, node->data);
-					node = n;
-				}
-				else if (n->getLeft() != nullptr) {
-					n = n->getLeft();
-					while (n->getRight() != nullptr)
-						n = n->getRight();
-					std::swap(n->data, node->data);
-					node = n;
-				}
-				else
-					break;
-		}
-		Node<Key_t> *p = n->getParent();
-		n->remove();
-		elems_num--;
-		if (p != nullptr)
-			fix(p);
+		auto r = this->unlinkNode(node);
+		node_t::destroy(node, alloc);
+		fixDeletion(r.parent, r.from_left);
+	}
+
+public:
+	AVLbase(const Compare_t &comp, const Allocator_t &alloc) : Base(comp, alloc) {}
+
+	void erase(const Key_t &key) {
+		eraseNode(findNode(key));
 	}
 
-	int size() const {
-		return elems_num;
+	template< class K, class C = Compare_t, class = typename C::is_transparent >
+	void erase(const K &key) {
+		eraseNode(findNode(key));
+	}
+
+	// Replaces the contents by the elements of [first, last), in O(n) if they are sorted
+	template< class Iterator_t >
+	void build(Iterator_t first, Iterator_t last) {
+		this->buildFrom(first, last, setBuiltTag);
 	}
 
 	void print() const {
 		if (root == nullptr)
 			return;
-		std::queue<Node<Key_t>*> q;
+		std::queue<node_t*> q;
 
-		int width = (1 << root->getHeight()) - 1;
+		int h = height(root);
+		int width = (1 << h) - 1;
 		q.push(root);
 		int pos_num = 1;
-		for (int j = 0; j < root->getHeight(); j++, pos_num = 2 * pos_num, width = width/2) {
+		for (int j = 0; j < h; j++, pos_num = 2 * pos_num, width = width/2) {
 			for (int k = 0; k < width/2; k++)
 				std::cout << ' ';
 			for (int i = 0; i < pos_num; i++) {
 				if (i > 0)
 					for (int k = 0; k < width; k++)
 						std::cout << ' ';
-				Node<Key_t> *node = q.front();
+				node_t *node = q.front();
 				q.pop();
 				if (node == nullptr) {
 					std::cout << ' ';
@@ -178,7 +303,7 @@ public:
 					q.push(nullptr);
 				}
 				else {
-					std::cout << node->data;
+					std::cout << keyOf(node);
 					q.push(node->getLeft());
 					q.push(node->getRight());
 				}
@@ -188,6 +313,30 @@ public:
 			std::cout << '\n';
 		}
 	}
+
+	void check() const {
+		check_rec(root);
+		this->checkCounts(root);
+	}
+};
+
+template< class Key_t, class Compare_t = std::less<Key_t>, class Allocator_t = PoolAllocator<Key_t>, bool Counted = false,
+	class Aggregate_t = void >
+class AVLtree : public TreeSet<JoinTree<AVLbase<Key_t, Key_t, Identity<Key_t>, Compare_t, Allocator_t, Counted, Aggregate_t>>> {
+public:
+	AVLtree(const Compare_t &comp = Compare_t(), const Allocator_t &alloc = Allocator_t())
+		: TreeSet<JoinTree<AVLbase<Key_t, Key_t, Identity<Key_t>, Compare_t, Allocator_t, Counted, Aggregate_t>>>(comp, alloc) {}
+};
+
+template< class Key_t, class Mapped_t, class Compare_t = std::less<Key_t>,
+	class Allocator_t = PoolAllocator<std::pair<const Key_t, Mapped_t>>, bool Counted = false,
+	class Aggregate_t = void >
+class AVLmap : public TreeMap<JoinTree<AVLbase<std::pair<const Key_t, Mapped_t>, Key_t,
+	SelectFirst<std::pair<const Key_t, Mapped_t>>, Compare_t, Allocator_t, Counted, Aggregate_t>>> {
+public:
+	AVLmap(const Compare_t &comp = Compare_t(), const Allocator_t &alloc = Allocator_t())
+		: TreeMap<JoinTree<AVLbase<std::pair<const Key_t, Mapped_t>, Key_t,
+			SelectFirst<std::pair<const Key_t, Mapped_t>>, Compare_t, Allocator_t, Counted, Aggregate_t>>>(comp, alloc) {}
 };
 
 #endif /* AVLTREE_HPP */
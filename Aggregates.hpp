@@ -0,0 +1,77 @@
+#ifndef AGGREGATES_HPP
+#define AGGREGATES_HPP
+
+#include <limits>
+#include <utility>
+
+// The value an aggregate is taken of: the key of a set or the mapped value of a map
+template< class Element_t >
+struct AggregatedValue {
+	static const Element_t &get(const Element_t &elem) {
+		return elem;
+	}
+};
+
+template< class Key_t, class Mapped_t >
+struct AggregatedValue<std::pair<const Key_t, Mapped_t>> {
+	static const Mapped_t &get(const std::pair<const Key_t, Mapped_t> &elem) {
+		return elem.second;
+	}
+};
+
+// Aggregate policies for the trees: sum, minimum and maximum of the values of the elements
+template< class Value_t >
+struct SumAggregate {
+	typedef Value_t value_type;
+
+	static Value_t identity() {
+		return Value_t();
+	}
+
+	static Value_t combine(const Value_t &a, const Value_t &b) {
+		return a + b;
+	}
+
+	template< class Element_t >
+	static Value_t of(const Element_t &elem) {
+		return AggregatedValue<Element_t>::get(elem);
+	}
+};
+
+template< class Value_t >
+struct MinAggregate {
+	typedef Value_t value_type;
+
+	static Value_t identity() {
+		return std::numeric_limits<Value_t>::max();
+	}
+
+	static Value_t combine(const Value_t &a, const Value_t &b) {
+		return (b < a ? b : a);
+	}
+
+	template< class Element_t >
+	static Value_t of(const Element_t &elem) {
+		return AggregatedValue<Element_t>::get(elem);
+	}
+};
+
+template< class Value_t >
+struct MaxAggregate {
+	typedef Value_t value_type;
+
+	static Value_t identity() {
+		return std::numeric_limits<Value_t>::lowest();
+	}
+
+	static Value_t combine(const Value_t &a, const Value_t &b) {
+		return (a < b ? b : a);
+	}
+
+	template< class Element_t >
+	static Value_t of(const Element_t &elem) {
+		return AggregatedValue<Element_t>::get(elem);
+	}
+};
+
+#endif /* AGGREGATES_HPP */
@@ -0,0 +1,98 @@
+#ifndef ANYTREE_HPP
+#define ANYTREE_HPP
+
+#include <memory>
+#include <utility>
+#include <functional>
+
+#include "TreeBase.hpp"
+
+/*
+A tree of any type with the keys of Key_t, chosen at run time, as in "--game avl|rb|bp".
+Every call goes through a virtual function; the code which knows the tree type
+at compile time should use it directly.
+*/
+template< class Key_t, class Compare_t = std::less<Key_t> >
+class AnyTree : public TreeBase<Key_t, Compare_t> {
+private:
+	struct Concept {
+		virtual ~Concept() = default;
+		virtual void insert(const Key_t &key) = 0;
+		virtual bool contains(const Key_t &key) const = 0;
+		virtual void erase(const Key_t &key) = 0;
+		virtual int size() const = 0;
+		virtual void clear() = 0;
+		virtual void print() const = 0;
+	};
+
+	template< class Tree_t >
+	struct Model : Concept {
+		Tree_t tree;
+
+		template< class... Args >
+		Model(Args&&... args) : tree(std::forward<Args>(args)...) {}
+
+		void insert(const Key_t &key) override {
+			tree.insert(key);
+		}
+
+		bool contains(const Key_t &key) const override {
+			return tree.contains(key);
+		}
+
+		void erase(const Key_t &key) override {
+			tree.erase(key);
+		}
+
+		int size() const override {
+			return tree.size();
+		}
+
+		void clear() override {
+			tree.clear();
+		}
+
+		void print() const override {
+			tree.print();
+		}
+	};
+
+	std::unique_ptr<Concept> impl;
+
+public:
+	typedef Key_t key_type;
+
+	// Builds the tree of the type Tree_t in place from the arguments
+	template< class Tree_t, class... Args >
+	explicit AnyTree(std::in_place_type_t<Tree_t>, Args&&... args)
+			: impl(new Model<Tree_t>(std::forward<Args>(args)...)) {
+		static_assert(is_tree_v<Tree_t>, "Tree_t must have the interface of TreeBase");
+		static_assert(std::is_same<typename Tree_t::key_type, Key_t>::value, "Tree_t must have the keys of Key_t");
+	}
+
+	void insert(const Key_t &key) {
+		impl->insert(key);
+	}
+
+	bool contains(const Key_t &key) const {
+		return impl->contains(key);
+	}
+
+	void erase(const Key_t &key) {
+		impl->erase(key);
+	}
+
+	int size() const {
+		return impl->size();
+	}
+
+	void clear() {
+		impl->clear();
+	}
+
+	void print() const {
+		impl->print();
+	}
+};
+
+#endif /* ANYTREE_HPP */
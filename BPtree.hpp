@@ -0,0 +1,505 @@
+#ifndef BPTREE_HPP
+#define BPTREE_HPP
+
+#include <functional>
+#include <utility>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <cstddef>
+
+#include "TreeBase.hpp"
+
+/*
+B+ tree with nodes of about NodeSize bytes. The keys are kept only in the leaves,
+in sorted arrays, and the leaves are linked in order for the scans. An inner node
+with k keys has k + 1 children; a key of it is not greater than any key of the
+child on its right and greater than all the keys of the child on its left.
+All the leaves are on the same level; every node but the root is at least half full.
+*/
+template< class Key_t, class Compare_t = std::less<Key_t>, std::size_t NodeSize = 256 >
+class BPtree : public TreeBase<Key_t, Compare_t> {
+private:
+	static constexpr int fit(std::size_t header, std::size_t item) {
+		return (NodeSize > header + 3 * item ? (NodeSize - header) / item : 3);
+	}
+
+	// The count takes a whole word next to the pointers
+	static constexpr int leaf_cap = fit(2 * sizeof(void*), sizeof(Key_t));
+	static constexpr int inner_cap = fit(2 * sizeof(void*), sizeof(Key_t) + sizeof(void*));
+
+	struct NodeBase {
+		int count = 0; // The number of keys
+	};
+
+	// The nodes start at cache lines, so a node of NodeSize bytes takes NodeSize / 64 of them
+	struct alignas(64) Leaf : NodeBase {
+		Leaf *next = nullptr;
+		Key_t keys[leaf_cap];
+	};
+
+	struct alignas(64) Inner : NodeBase {
+		NodeBase *children[inner_cap + 1];
+		Key_t keys[inner_cap];
+	};
+
+	NodeBase *root = nullptr;
+	Leaf *first = nullptr;
+	int levels = 0; // 1 if the root is a leaf
+	int elems_num = 0;
+	int leaves_num = 0;
+	int inners_num = 0;
+	Compare_t comp;
+
+	static Leaf *asLeaf(NodeBase *node) {
+		return static_cast<Leaf*>(node);
+	}
+
+	static Inner *asInner(NodeBase *node) {
+		return static_cast<Inner*>(node);
+	}
+
+	// The first of the n keys not less than the key
+	int lowerBound(const Key_t *keys, int n, const Key_t &key) const {
+		return std::lower_bound(keys, keys + n, key, comp) - keys;
+	}
+
+	// The child of the inner node where the key must be
+	int childIndex(const Inner *node, const Key_t &key) const {
+		return std::upper_bound(node->keys, node->keys + node->count, key, comp) - node->keys;
+	}
+
+	Leaf *findLeaf(const Key_t &key) const {
+		NodeBase *node = root;
+		for (int level = levels; level > 1; level--)
+			node = asInner(node)->children[childIndex(asInner(node), key)];
+		return asLeaf(node);
+	}
+
+	Leaf *newLeaf() {
+		leaves_num++;
+		return new Leaf; // The keys are not zeroed
+	}
+
+	Inner *newInner() {
+		inners_num++;
+		return new Inner;
+	}
+
+	void deleteLeaf(Leaf *leaf) {
+		leaves_num--;
+		delete leaf;
+	}
+
+	void deleteInner(Inner *node) {
+		inners_num--;
+		delete node;
+	}
+
+	/*
+	Inserts the key into the subtree. Returns false if the key is already there.
+	If the node splits, "right" is set to the new node on its right and "sep" to the key between them.
+	*/
+	bool insertRec(NodeBase *node, int level, const Key_t &key, Key_t &sep, NodeBase *&right) {
+		if (level == 1) {
+			Leaf *leaf = asLeaf(node);
+			int pos = lowerBound(leaf->keys, leaf->count, key);
+			if (pos < leaf->count && !comp(key, leaf->keys[pos]))
+				return false;
+			if (leaf->count < leaf_cap) {
+				std::move_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+				leaf->keys[pos] = key;
+				leaf->count++;
+				return true;
+			}
+
+			std::array<Key_t, leaf_cap + 1> all;
+			std::move(leaf->keys, leaf->keys + pos, all.begin());
+			all[pos] = key;
+			std::move(leaf->keys + pos, leaf->keys + leaf_cap, all.begin() + pos + 1);
+
+			Leaf *new_leaf = newLeaf();
+			leaf->count = (leaf_cap + 1) / 2;
+			new_leaf->count = leaf_cap + 1 - leaf->count;
+			std::move(all.begin(), all.begin() + leaf->count, leaf->keys);
+			std::move(all.begin() + leaf->count, all.end(), new_leaf->keys);
+			new_leaf->next = leaf->next;
+			leaf->next = new_leaf;
+
+			sep = new_leaf->keys[0];
+			right = new_leaf;
+			return true;
+		}
+
+		Inner *inner = asInner(node);
+		int idx = childIndex(inner, key);
+		Key_t child_sep;
+		NodeBase *child_right = nullptr;
+		if (!insertRec(inner->children[idx], level - 1, key, child_sep, child_right))
+			return false;
+		if (child_right == nullptr)
+			return true;
+
+		if (inner->count < inner_cap) {
+			std::move_backward(inner->keys + idx, inner->keys + inner->count, inner->keys + inner->count + 1);
+			std::move_backward(inner->children + idx + 1, inner->children + inner->count + 1,
+				inner->children + inner->count + 2);
+			inner->keys[idx] = std::move(child_sep);
+			inner->children[idx + 1] = child_right;
+			inner->count++;
+			return true;
+		}
+
+		std::array<Key_t, inner_cap + 1> keys;
+		std::array<NodeBase*, inner_cap + 2> children;
+		std::move(inner->keys, inner->keys + idx, keys.begin());
+		keys[idx] = std::move(child_sep);
+		std::move(inner->keys + idx, inner->keys + inner_cap, keys.begin() + idx + 1);
+		std::copy(inner->children, inner->children + idx + 1, children.begin());
+		children[idx + 1] = child_right;
+		std::copy(inner->children + idx + 1, inner->children + inner_cap + 1, children.begin() + idx + 2);
+
+		// The middle key goes up
+		Inner *new_inner = newInner();
+		int m = (inner_cap + 1) / 2;
+		inner->count = m;
+		new_inner->count = inner_cap - m;
+		std::move(keys.begin(), keys.begin() + m, inner->keys);
+		std::copy(children.begin(), children.begin() + m + 1, inner->children);
+		sep = std::move(keys[m]);
+		std::move(keys.begin() + m + 1, keys.end(), new_inner->keys);
+		std::copy(children.begin() + m + 1, children.end(), new_inner->children);
+		right = new_inner;
+		return true;
+	}
+
+	// Removes the key from the subtree, returns false if it is not there
+	bool eraseRec(NodeBase *node, int level, const Key_t &key) {
+		if (level == 1) {
+			Leaf *leaf = asLeaf(node);
+			int pos = lowerBound(leaf->keys, leaf->count, key);
+			if (pos == leaf->count || comp(key, leaf->keys[pos]))
+				return false;
+			std::move(leaf->keys + pos + 1, leaf->keys + leaf->count, leaf->keys + pos);
+			leaf->count--;
+			return true;
+		}
+
+		Inner *inner = asInner(node);
+		int idx = childIndex(inner, key);
+		if (!eraseRec(inner->children[idx], level - 1, key))
+			return false;
+		if (inner->children[idx]->count < (level == 2 ? leaf_cap : inner_cap) / 2)
+			fixUnderflow(inner, idx, level - 1);
+		return true;
+	}
+
+	// Removes the key idx and the child idx + 1 of the inner node
+	static void removeFromInner(Inner *node, int idx) {
+		std::move(node->keys + idx + 1, node->keys + node->count, node->keys + idx);
+		std::copy(node->children + idx + 2, node->children + node->count + 1, node->children + idx + 1);
+		node->count--;
+	}
+
+	// The child idx of the node on the given level is less than half full: borrows a key from a sibling or merges with it
+	void fixUnderflow(Inner *parent, int idx, int level) {
+		int min = (level == 1 ? leaf_cap : inner_cap) / 2;
+		NodeBase *left = (idx > 0 ? parent->children[idx - 1] : nullptr);
+		NodeBase *right = (idx < parent->count ? parent->children[idx + 1] : nullptr);
+		NodeBase *child = parent->children[idx];
+
+		if (level == 1) {
+			Leaf *c = asLeaf(child);
+			if (left != nullptr && left->count > min) {
+				Leaf *l = asLeaf(left);
+				std::move_backward(c->keys, c->keys + c->count, c->keys + c->count + 1);
+				c->keys[0] = std::move(l->keys[--l->count]);
+				c->count++;
+				parent->keys[idx - 1] = c->keys[0];
+			}
+			else if (right != nullptr && right->count > min) {
+				Leaf *r = asLeaf(right);
+				c->keys[c->count++] = std::move(r->keys[0]);
+				std::move(r->keys + 1, r->keys + r->count, r->keys);
+				r->count--;
+				parent->keys[idx] = r->keys[0];
+			}
+			else {
+				// The right one of the two leaves is merged into the left one
+				if (left == nullptr) {
+					left = c;
+					c = asLeaf(right);
+					idx++;
+				}
+				Leaf *l = asLeaf(left);
+				std::move(c->keys, c->keys + c->count, l->keys + l->count);
+				l->count += c->count;
+				l->next = c->next;
+				deleteLeaf(c);
+				removeFromInner(parent, idx - 1);
+			}
+			return;
+		}
+
+		Inner *c = asInner(child);
+		if (left != nullptr && left->count > min) {
+			Inner *l = asInner(left);
+			std::move_backward(c->keys, c->keys + c->count, c->keys + c->count + 1);
+			std::copy_backward(c->children, c->children + c->count + 1, c->children + c->count + 2);
+			c->keys[0] = std::move(parent->keys[idx - 1]);
+			c->children[0] = l->children[l->count];
+			c->count++;
+			parent->keys[idx - 1] = std::move(l->keys[--l->count]);
+		}
+		else if (right != nullptr && right->count > min) {
+			Inner *r = asInner(right);
+			c->keys[c->count] = std::move(parent->keys[idx]);
+			c->children[c->count + 1] = r->children[0];
+			c->count++;
+			parent->keys[idx] = std::move(r->keys[0]);
+			std::move(r->keys + 1, r->keys + r->count, r->keys);
+			std::copy(r->children + 1, r->children + r->count + 1, r->children);
+			r->count--;
+		}
+		else {
+			if (left == nullptr) {
+				left = c;
+				c = asInner(right);
+				idx++;
+			}
+			Inner *l = asInner(left);
+			l->keys[l->count] = std::move(parent->keys[idx - 1]);
+			std::move(c->keys, c->keys + c->count, l->keys + l->count + 1);
+			std::copy(c->children, c->children + c->count + 1, l->children + l->count + 1);
+			l->count += c->count + 1;
+			deleteInner(c);
+			removeFromInner(parent, idx - 1);
+		}
+	}
+
+	void destroy(NodeBase *node, int level) {
+		if (level == 1) {
+			deleteLeaf(asLeaf(node));
+			return;
+		}
+		Inner *inner = asInner(node);
+		for (int i = 0; i <= inner->count; i++)
+			destroy(inner->children[i], level - 1);
+		deleteInner(inner);
+	}
+
+	// Returns the number of keys in the subtree, whose keys must be in [lo, hi] if the bounds are given
+	int check_rec(NodeBase *node, int level, const Key_t *lo, const Key_t *hi, bool is_root, Leaf *&expected) const {
+		if (!is_root && node->count < (level == 1 ? leaf_cap : inner_cap) / 2)
+			throw "Tree is incorrect!";
+		if (level == 1) {
+			Leaf *leaf = asLeaf(node);
+			if (leaf != expected)
+				throw "Tree is incorrect!";
+			expected = leaf->next;
+			for (int i = 0; i < leaf->count; i++) {
+				if (i > 0 && !comp(leaf->keys[i - 1], leaf->keys[i]))
+					throw "Tree is incorrect!";
+				if ((lo != nullptr && comp(leaf->keys[i], *lo)) || (hi != nullptr && !comp(leaf->keys[i], *hi)))
+					throw "Tree is incorrect!";
+			}
+			return leaf->count;
+		}
+		Inner *inner = asInner(node);
+		int n = 0;
+		for (int i = 0; i <= inner->count; i++)
+			n += check_rec(inner->children[i], level - 1, i > 0 ? &inner->keys[i - 1] : lo,
+				i < inner->count ? &inner->keys[i] : hi, false, expected);
+		return n;
+	}
+
+public:
+	typedef Key_t value_type;
+
+	// Walks the keys in order along the linked leaves
+	class const_iterator {
+	private:
+		const Leaf *leaf;
+		int pos;
+
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef const Key_t value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const Key_t *pointer;
+		typedef const Key_t &reference;
+
+		const_iterator(const Leaf *leaf = nullptr, int pos = 0) : leaf(leaf), pos(pos) {
+			// The end of a leaf is the beginning of the next one
+			if (leaf != nullptr && pos == leaf->count) {
+				this->leaf = leaf->next;
+				this->pos = 0;
+			}
+		}
+
+		reference operator*() const {
+			return leaf->keys[pos];
+		}
+
+		pointer operator->() const {
+			return &leaf->keys[pos];
+		}
+
+		const_iterator &operator++() {
+			if (++pos == leaf->count) {
+				leaf = leaf->next;
+				pos = 0;
+			}
+			return *this;
+		}
+
+		const_iterator operator++(int) {
+			const_iterator old = *this;
+			++*this;
+			return old;
+		}
+
+		bool operator==(const const_iterator &other) const {
+			return leaf == other.leaf && pos == other.pos;
+		}
+
+		bool operator!=(const const_iterator &other) const {
+			return !(*this == other);
+		}
+	};
+	typedef const_iterator iterator;
+
+	BPtree(const Compare_t &comp = Compare_t()) : comp(comp) {}
+
+	BPtree(const BPtree &) = delete;
+	BPtree &operator=(const BPtree &) = delete;
+
+	~BPtree() {
+		clear();
+	}
+
+	void insert(const Key_t &key) {
+		if (root == nullptr) {
+			Leaf *leaf = newLeaf();
+			leaf->keys[0] = key;
+			leaf->count = 1;
+			root = first = leaf;
+			levels = 1;
+			elems_num = 1;
+			return;
+		}
+		Key_t sep;
+		NodeBase *right = nullptr;
+		if (!insertRec(root, levels, key, sep, right))
+			return;
+		elems_num++;
+		if (right != nullptr) {
+			Inner *top = newInner();
+			top->count = 1;
+			top->keys[0] = std::move(sep);
+			top->children[0] = root;
+			top->children[1] = right;
+			root = top;
+			levels++;
+		}
+	}
+
+	bool contains(const Key_t &key) const {
+		if (root == nullptr)
+			return false;
+		Leaf *leaf = findLeaf(key);
+		int pos = lowerBound(leaf->keys, leaf->count, key);
+		return pos < leaf->count && !comp(key, leaf->keys[pos]);
+	}
+
+	void erase(const Key_t &key) {
+		if (root == nullptr || !eraseRec(root, levels, key))
+			return;
+		elems_num--;
+		if (levels > 1 && root->count == 0) {
+			Inner *old = asInner(root);
+			root = old->children[0];
+			deleteInner(old);
+			levels--;
+		}
+		else if (levels == 1 && root->count == 0) {
+			deleteLeaf(asLeaf(root));
+			root = first = nullptr;
+			levels = 0;
+		}
+	}
+
+	int size() const {
+		return elems_num;
+	}
+
+	void clear() {
+		if (root != nullptr)
+			destroy(root, levels);
+		root = first = nullptr;
+		levels = 0;
+		elems_num = 0;
+	}
+
+	const_iterator begin() const {
+		return const_iterator(first, 0);
+	}
+
+	const_iterator end() const {
+		return const_iterator();
+	}
+
+	// The first key not less than the key
+	const_iterator lower_bound(const Key_t &key) const {
+		if (root == nullptr)
+			return end();
+		Leaf *leaf = findLeaf(key);
+		return const_iterator(leaf, lowerBound(leaf->keys, leaf->count, key));
+	}
+
+	// Calls f for every key in [lo, hi) in order
+	template< class Function_t >
+	void for_each(const Key_t &lo, const Key_t &hi, Function_t f) const {
+		for (const_iterator it = lower_bound(lo), last = end(); it != last && comp(*it, hi); ++it)
+			f(*it);
+	}
+
+	// Bytes taken by the tree and its nodes
+	std::size_t memoryUsage() const {
+		return sizeof(*this) + leaves_num * sizeof(Leaf) + inners_num * sizeof(Inner);
+	}
+
+	void print() const {
+		std::vector<NodeBase*> cur, next;
+		if (root != nullptr)
+			cur.push_back(root);
+		for (int level = levels; level > 0; level--, cur.swap(next), next.clear()) {
+			for (NodeBase *node : cur) {
+				std::cout << '[';
+				if (level == 1)
+					for (int i = 0; i < node->count; i++)
+						std::cout << (i > 0 ? " " : "") << asLeaf(node)->keys[i];
+				else {
+					Inner *inner = asInner(node);
+					for (int i = 0; i < inner->count; i++)
+						std::cout << (i > 0 ? " " : "") << inner->keys[i];
+					next.insert(next.end(), inner->children, inner->children + inner->count + 1);
+				}
+				std::cout << "] ";
+			}
+			std::cout << '\n';
+		}
+	}
+
+	void check() const {
+		if (root == nullptr)
+			return;
+		Leaf *expected = first;
+		if (check_rec(root, levels, nullptr, nullptr, true, expected) != elems_num || expected != nullptr)
+			throw "Tree is incorrect!";
+	}
+};
+
+#endif /* BPTREE_HPP */
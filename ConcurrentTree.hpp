@@ -0,0 +1,147 @@
+#ifndef CONCURRENTTREE_HPP
+#define CONCURRENTTREE_HPP
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <cstddef>
+
+#include "TreeBase.hpp"
+
+/*
+Any of the trees made usable from many threads by the left-right technique. There are
+two copies of the tree: the readers go to one of them, and a writer changes the other
+one, switches the readers to it and, after the readers of the old copy have left,
+repeats the change there. So the readers take no locks, never retry and never wait,
+and nothing is freed under them. The writers go one by one.
+*/
+template< class Tree_t >
+class ConcurrentTree : public TreeBase<typename Tree_t::key_type, typename Tree_t::key_compare> {
+private:
+	// Readers of one copy are counted in separate cache lines, chosen by the thread
+	static constexpr unsigned slots = 64;
+
+	struct alignas(64) Counter {
+		std::atomic<long> readers{0};
+	};
+
+	struct Indicator {
+		Counter counters[slots];
+
+		bool empty() const {
+			for (auto &c : counters)
+				if (c.readers.load() != 0)
+					return false;
+			return true;
+		}
+
+		void waitEmpty() const {
+			while (!empty())
+				std::this_thread::yield();
+		}
+	};
+
+	Tree_t trees[2];
+	std::atomic<int> reading{0}; // The copy which the readers use
+	std::atomic<int> version{0}; // The indicator which new readers arrive at
+	mutable Indicator indicators[2];
+	std::mutex writer;
+
+	static unsigned slot() {
+		static std::atomic<unsigned> next{0};
+		thread_local unsigned s = next++ % slots;
+		return s;
+	}
+
+	/*
+	Makes the change on the copy nobody reads, moves the readers there and,
+	when the last reader of the other copy has gone, makes it there too.
+	*/
+	template< class Function_t >
+	void write(Function_t f) {
+		std::lock_guard<std::mutex> lock(writer);
+		int r = reading.load();
+		f(trees[1 - r]);
+		reading.store(1 - r);
+		int v = version.load();
+		indicators[1 - v].waitEmpty();
+		version.store(1 - v);
+		indicators[v].waitEmpty();
+		f(trees[r]);
+	}
+
+public:
+	typedef typename Tree_t::key_type key_type;
+	typedef typename Tree_t::key_compare key_compare;
+
+	ConcurrentTree() = default;
+	ConcurrentTree(const ConcurrentTree &) = delete;
+	ConcurrentTree &operator=(const ConcurrentTree &) = delete;
+
+	/*
+	Calls f with a tree which does not change until f returns, as for the range scans.
+	Writers wait for f, so it must be short.
+	*/
+	template< class Function_t >
+	decltype(auto) read(Function_t f) const {
+		Counter &c = indicators[version.load()].counters[slot()];
+		c.readers++;
+		struct Departure {
+			Counter &c;
+			~Departure() {
+				c.readers--;
+			}
+		} departure{c};
+		return f(static_cast<const Tree_t&>(trees[reading.load()]));
+	}
+
+	void insert(const key_type &key) {
+		write([&key](Tree_t &tree) {
+			tree.insert(key);
+		});
+	}
+
+	void erase(const key_type &key) {
+		write([&key](Tree_t &tree) {
+			tree.erase(key);
+		});
+	}
+
+	void clear() {
+		write([](Tree_t &tree) {
+			tree.clear();
+		});
+	}
+
+	bool contains(const key_type &key) const {
+		return read([&key](const Tree_t &tree) {
+			return tree.contains(key);
+		});
+	}
+
+	int size() const {
+		return read([](const Tree_t &tree) {
+			return tree.size();
+		});
+	}
+
+	template< class Function_t >
+	void for_each(const key_type &lo, const key_type &hi, Function_t f) const {
+		read([&](const Tree_t &tree) {
+			tree.for_each(lo, hi, f);
+		});
+	}
+
+	void print() const {
+		read([](const Tree_t &tree) {
+			tree.print();
+		});
+	}
+
+	std::size_t memoryUsage() const {
+		return sizeof(*this) - sizeof(trees) + trees[0].memoryUsage() + trees[1].memoryUsage();
+	}
+};
+
+#endif /* CONCURRENTTREE_HPP */
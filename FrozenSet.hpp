@@ -0,0 +1,158 @@
+#ifndef FROZENSET_HPP
+#define FROZENSET_HPP
+
+#include <functional>
+#include <utility>
+#include <cstddef>
+#include <new>
+
+/*
+Immutable set of keys for lookups only, built from a sorted sequence. The keys lie in
+one array in the Eytzinger (BFS) order: the children of the slot k are 2k and 2k + 1.
+The search has no branches on the comparisons, and the cache line with the descendants
+a few levels down is prefetched on every step, so the misses of the next levels overlap
+with the comparisons of the current ones.
+*/
+template< class Key_t, class Compare_t = std::less<Key_t> >
+class FrozenSet {
+private:
+	static constexpr std::size_t line = 64;
+
+	// So many descendants on one level lie in a cache line
+	static constexpr std::size_t prefetchStep() {
+		std::size_t step = 1;
+		while (step * 2 * sizeof(Key_t) <= line)
+			step *= 2;
+		return step;
+	}
+
+	Key_t *keys = nullptr; // The slot 0 is not used
+	std::size_t n = 0;
+	Compare_t comp;
+
+	// Puts the keys given by next() to the subtree of the slot k in order, counting them in built
+	template< class Next_t >
+	void fill(Next_t &next, std::size_t k, std::size_t &built) {
+		if (k > n)
+			return;
+		fill(next, 2 * k, built);
+		new (keys + k) Key_t(next());
+		built++;
+		fill(next, 2 * k + 1, built);
+	}
+
+	// Destroys the first "left" keys put by fill to the subtree of the slot k
+	void unfill(std::size_t k, std::size_t &left) {
+		if (k > n || left == 0)
+			return;
+		unfill(2 * k, left);
+		if (left == 0)
+			return;
+		keys[k].~Key_t();
+		left--;
+		unfill(2 * k + 1, left);
+	}
+
+	// If a key cannot be copied, the keys already built are destroyed and the set stays empty
+	template< class Next_t >
+	void build(Next_t &next) {
+		keys = static_cast<Key_t*>(::operator new((n + 1) * sizeof(Key_t), std::align_val_t(line)));
+		std::size_t built = 0;
+		try {
+			fill(next, 1, built);
+		}
+		catch (...) {
+			unfill(1, built);
+			::operator delete(keys, std::align_val_t(line));
+			keys = nullptr;
+			n = 0;
+			throw;
+		}
+	}
+
+	void destroy() {
+		if (keys == nullptr)
+			return;
+		for (std::size_t k = 1; k <= n; k++)
+			keys[k].~Key_t();
+		::operator delete(keys, std::align_val_t(line));
+		keys = nullptr;
+		n = 0;
+	}
+
+public:
+	typedef Key_t key_type;
+
+	FrozenSet(const Compare_t &comp = Compare_t()) : comp(comp) {}
+
+	// The keys in [first, last) must be sorted and unique
+	template< class Iterator_t >
+	FrozenSet(Iterator_t first, Iterator_t last, const Compare_t &comp = Compare_t()) : comp(comp) {
+		for (Iterator_t it = first; it != last; ++it)
+			n++;
+		auto next = [&first]() -> decltype(auto) {
+			return *first++;
+		};
+		build(next);
+	}
+
+	// The n keys come from next() in order
+	template< class Next_t >
+	static FrozenSet fromSorted(std::size_t n, Next_t next, const Compare_t &comp = Compare_t()) {
+		FrozenSet res(comp);
+		res.n = n;
+		res.build(next);
+		return res;
+	}
+
+	FrozenSet(FrozenSet &&other) : keys(other.keys), n(other.n), comp(other.comp) {
+		other.keys = nullptr;
+		other.n = 0;
+	}
+
+	FrozenSet &operator=(FrozenSet &&other) {
+		if (this != &other) {
+			destroy();
+			keys = other.keys;
+			n = other.n;
+			comp = other.comp;
+			other.keys = nullptr;
+			other.n = 0;
+		}
+		return *this;
+	}
+
+	FrozenSet(const FrozenSet &) = delete;
+	FrozenSet &operator=(const FrozenSet &) = delete;
+
+	~FrozenSet() {
+		destroy();
+	}
+
+	// The first key not less than the key, or null
+	const Key_t *lower_bound(const Key_t &key) const {
+		std::size_t k = 1;
+		while (k <= n) {
+			__builtin_prefetch(keys + k * prefetchStep());
+			k = 2 * k + comp(keys[k], key);
+		}
+		// Going up to where the search turned left for the last time
+		k >>= __builtin_ffsll(~(unsigned long long)k);
+		return (k == 0 ? nullptr : keys + k);
+	}
+
+	bool contains(const Key_t &key) const {
+		const Key_t *res = lower_bound(key);
+		return res != nullptr && !comp(key, *res);
+	}
+
+	int size() const {
+		return n;
+	}
+
+	std::size_t memoryUsage() const {
+		return sizeof(*this) + (n + 1) * sizeof(Key_t);
+	}
+};
+
+#endif /* FROZENSET_HPP */
@@ -0,0 +1,363 @@
+#ifndef JOINTREE_HPP
+#define JOINTREE_HPP
+
+#include <vector>
+#include <cstddef>
+
+#include "ThreadPool.hpp"
+
+/*
+Split, join and the set operations on top of a balanced tree engine, which gives
+the rank of a tree (its height or black height), cuts subtrees off and joins two
+trees with a node between them in O(rank difference).
+
+The nodes are moved between trees only if their allocators are equal, otherwise
+the elements which change their tree are copied.
+*/
+template< class Tree_t >
+class JoinTree : public Tree_t {
+protected:
+	typedef typename Tree_t::node_t node_t;
+
+	// A tree taken apart from any container: its root, which has no parent, and its rank
+	struct Part {
+		node_t *root = nullptr;
+		int rank = 0;
+	};
+
+	// The set operations fork only for operands larger than that
+	static constexpr int parallel_min = 1 << 14;
+
+	static void cut(Part t, Part &left, Part &right) {
+		left.root = Tree_t::cutChild(t.root, t.rank, true, left.rank);
+		right.root = Tree_t::cutChild(t.root, t.rank, false, right.rank);
+	}
+
+	static Part joinParts(Part left, node_t *middle, Part right) {
+		Part res;
+		res.root = Tree_t::joinNodes(left.root, left.rank, middle, right.root, right.rank, res.rank);
+		return res;
+	}
+
+	// Takes the largest node out of the tree and leaves the others in "rest"
+	static node_t *splitLast(Part t, Part &rest) {
+		node_t *node = t.root;
+		Part left, right;
+		cut(t, left, right);
+		if (right.root == nullptr) {
+			rest = left;
+			return node;
+		}
+		Part right_rest;
+		node_t *last = splitLast(right, right_rest);
+		rest = joinParts(left, node, right_rest);
+		return last;
+	}
+
+	// Joins the trees without a node between them
+	static Part joinParts(Part left, Part right) {
+		if (left.root == nullptr)
+			return right;
+		if (right.root == nullptr)
+			return left;
+		Part rest;
+		node_t *last = splitLast(left, rest);
+		return joinParts(rest, last, right);
+	}
+
+	/*
+	Splits the tree into the keys less than the key and greater than it.
+	Returns the node with the key itself, taken apart from both, or null.
+	*/
+	node_t *splitPart(Part t, const typename Tree_t::key_type &key, Part &left, Part &right) const {
+		if (t.root == nullptr) {
+			left = right = Part();
+			return nullptr;
+		}
+		node_t *node = t.root;
+		Part l, r;
+		cut(t, l, r);
+		if (this->comp(key, Tree_t::keyOf(node))) {
+			Part rl;
+			node_t *found = splitPart(l, key, left, rl);
+			right = joinParts(rl, node, r);
+			return found;
+		}
+		if (this->comp(Tree_t::keyOf(node), key)) {
+			Part lr;
+			node_t *found = splitPart(r, key, lr, right);
+			left = joinParts(l, node, lr);
+			return found;
+		}
+		left = l;
+		right = r;
+		return node;
+	}
+
+	// Runs both functions, in parallel while there are forks left. Each gets its list of dropped nodes.
+	template< class Left_t, class Right_t >
+	static void inParallel(ThreadPool *pool, int forks, std::vector<node_t*> &dropped, Left_t left, Right_t right) {
+		if (forks == 0) {
+			left(dropped);
+			right(dropped);
+			return;
+		}
+		std::vector<node_t*> right_dropped;
+		auto handle = pool->fork([&]() {
+			right(right_dropped);
+		});
+		left(dropped);
+		handle.join();
+		dropped.insert(dropped.end(), right_dropped.begin(), right_dropped.end());
+	}
+
+	/*
+	The set operations split the second tree by the root of the first one and go on
+	with the two halves independently. The nodes which are not needed any more go
+	to "dropped" as whole subtrees; nothing is allocated or freed on the way, so the
+	halves can run on different threads.
+	*/
+	Part unite(Part a, Part b, std::vector<node_t*> &dropped, ThreadPool *pool, int forks) const {
+		if (a.root == nullptr)
+			return b;
+		if (b.root == nullptr)
+			return a;
+		node_t *node = a.root;
+		Part al, ar, bl, br, l, r;
+		cut(a, al, ar);
+		node_t *same = splitPart(b, Tree_t::keyOf(node), bl, br);
+		if (same != nullptr)
+			dropped.push_back(same);
+		inParallel(pool, forks, dropped, [&](std::vector<node_t*> &d) {
+			l = unite(al, bl, d, pool, forks ? forks - 1 : 0);
+		}, [&](std::vector<node_t*> &d) {
+			r = unite(ar, br, d, pool, forks ? forks - 1 : 0);
+		});
+		return joinParts(l, node, r);
+	}
+
+	Part intersect(Part a, Part b, std::vector<node_t*> &dropped, ThreadPool *pool, int forks) const {
+		if (a.root == nullptr || b.root == nullptr) {
+			if (a.root != nullptr)
+				dropped.push_back(a.root);
+			if (b.root != nullptr)
+				dropped.push_back(b.root);
+			return Part();
+		}
+		node_t *node = a.root;
+		Part al, ar, bl, br, l, r;
+		cut(a, al, ar);
+		node_t *same = splitPart(b, Tree_t::keyOf(node), bl, br);
+		inParallel(pool, forks, dropped, [&](std::vector<node_t*> &d) {
+			l = intersect(al, bl, d, pool, forks ? forks - 1 : 0);
+		}, [&](std::vector<node_t*> &d) {
+			r = intersect(ar, br, d, pool, forks ? forks - 1 : 0);
+		});
+		if (same != nullptr) {
+			dropped.push_back(same);
+			return joinParts(l, node, r);
+		}
+		dropped.push_back(node);
+		return joinParts(l, r);
+	}
+
+	// Here the first tree is split by the root of the second one
+	Part subtract(Part a, Part b, std::vector<node_t*> &dropped, ThreadPool *pool, int forks) const {
+		if (a.root == nullptr || b.root == nullptr) {
+			if (b.root != nullptr)
+				dropped.push_back(b.root);
+			return a;
+		}
+		node_t *node = b.root;
+		Part al, ar, bl, br, l, r;
+		cut(b, bl, br);
+		node_t *same = splitPart(a, Tree_t::keyOf(node), al, ar);
+		dropped.push_back(node);
+		if (same != nullptr)
+			dropped.push_back(same);
+		inParallel(pool, forks, dropped, [&](std::vector<node_t*> &d) {
+			l = subtract(al, bl, d, pool, forks ? forks - 1 : 0);
+		}, [&](std::vector<node_t*> &d) {
+			r = subtract(ar, br, d, pool, forks ? forks - 1 : 0);
+		});
+		return joinParts(l, r);
+	}
+
+	static int countNodes(node_t *tree) {
+		int n = 0;
+		for (node_t *node = (tree == nullptr ? nullptr : node_t::leftmost(tree)); node != nullptr; node = node->next())
+			n++;
+		return n;
+	}
+
+	// Counts the nodes of two trees with n nodes in total in turns, so it takes as long as the smaller one
+	static int countLeft(node_t *left, node_t *right, int n) {
+		node_t *x = (left == nullptr ? nullptr : node_t::leftmost(left));
+		node_t *y = (right == nullptr ? nullptr : node_t::leftmost(right));
+		int count = 0;
+		for (; x != nullptr && y != nullptr; count++) {
+			x = x->next();
+			y = y->next();
+		}
+		return (x == nullptr ? count : n - count);
+	}
+
+	// A copy of the tree of n nodes made by this tree's allocator
+	Part copyOf(node_t *tree, int n) {
+		node_t *node = (tree == nullptr ? nullptr : node_t::leftmost(tree));
+		auto next = [&node]() -> const typename Tree_t::value_type & {
+			node_t *cur = node;
+			node = node->next();
+			return cur->data;
+		};
+		auto setTag = Tree_t::setBuiltTag;
+		Part res;
+		res.root = this->buildSorted(next, n, setTag);
+		res.rank = Tree_t::rankOf(res.root);
+		return res;
+	}
+
+	// Takes all the elements of the tree, which becomes empty
+	Part take(JoinTree &other) {
+		Part res;
+		if (this->alloc == other.alloc) {
+			res.root = other.root;
+			res.rank = Tree_t::rankOf(other.root);
+			other.root = nullptr;
+			other.elems_num = 0;
+		}
+		else {
+			res = copyOf(other.root, other.elems_num);
+			other.clear();
+		}
+		return res;
+	}
+
+	// Gives the elements to the tree, which must be empty
+	void give(Part t, int n, JoinTree &other) {
+		if (this->alloc == other.alloc) {
+			other.root = t.root;
+			other.elems_num = n;
+			return;
+		}
+		other.root = other.copyOf(t.root, n).root;
+		other.elems_num = n;
+		node_t::destroy(t.root, this->alloc);
+	}
+
+	typedef Part (JoinTree::*Operation_t)(Part, Part, std::vector<node_t*>&, ThreadPool*, int) const;
+
+	// Applies the set operation to this tree and the other one, whose nodes are this tree's already
+	void combine(Operation_t op, Part other, int other_size, ThreadPool *pool) {
+		int forks = 0;
+		if (pool != nullptr && pool->size() > 1 && this->elems_num >= parallel_min && other_size >= parallel_min)
+			while ((1u << forks) < 2 * pool->size())
+				forks++;
+
+		Part t;
+		t.root = this->root;
+		t.rank = Tree_t::rankOf(this->root);
+		this->root = nullptr;
+		std::vector<node_t*> dropped;
+		t = (this->*op)(t, other, dropped, pool, forks);
+		this->root = t.root;
+
+		int lost = 0;
+		for (node_t *node : dropped) {
+			lost += countNodes(node);
+			node_t::destroy(node, this->alloc);
+		}
+		this->elems_num += other_size - lost;
+	}
+
+public:
+	using Tree_t::Tree_t;
+
+	// Leaves the elements less than the key here and moves the others to "right" instead of its contents
+	void split(const typename Tree_t::key_type &key, JoinTree &right) {
+		if (&right == this)
+			throw 1;
+		right.clear();
+		Part t, l, r;
+		t.root = this->root;
+		t.rank = Tree_t::rankOf(this->root);
+		node_t *found = splitPart(t, key, l, r);
+		if (found != nullptr)
+			r = joinParts(Part(), found, r);
+		int n;
+		if constexpr (node_t::counted)
+			n = node_t::subtreeSize(l.root);
+		else
+			n = countLeft(l.root, r.root, this->elems_num);
+		this->root = l.root;
+		give(r, this->elems_num - n, right);
+		this->elems_num = n;
+	}
+
+	/*
+	Replaces the contents by the elements of "left", the element and the elements of "right",
+	which become empty. The keys of "left" must be less than the key of the element and
+	the keys of "right" greater. Either of them may be this tree.
+	*/
+	void join(JoinTree &left, const typename Tree_t::value_type &elem, JoinTree &right) {
+		if (&left == &right)
+			throw 1;
+		const typename Tree_t::key_type &key = Tree_t::keyOf(elem);
+		if (left.root != nullptr && !this->comp(Tree_t::keyOf(node_t::rightmost(left.root)), key))
+			throw 1;
+		if (right.root != nullptr && !this->comp(key, Tree_t::keyOf(node_t::leftmost(right.root))))
+			throw 1;
+
+		int n = left.elems_num + right.elems_num + 1;
+		if (&left != this && &right != this)
+			this->clear();
+		Part l = take(left), r = take(right);
+		Part t = joinParts(l, node_t::create(this->alloc, elem), r);
+		this->root = t.root;
+		this->elems_num = n;
+	}
+
+	/*
+	The set operations with a tree of m elements take O(m log(n/m + 1)) after the other
+	tree's elements are taken (or copied, if they are another allocator's). The two halves
+	of large trees are processed on the threads of the pool, or on this one if it is null.
+	*/
+	void union_with(const JoinTree &other, ThreadPool *pool = &ThreadPool::shared()) {
+		if (&other != this)
+			combine(&JoinTree::unite, copyOf(other.root, other.elems_num), other.elems_num, pool);
+	}
+
+	void union_with(JoinTree &&other, ThreadPool *pool = &ThreadPool::shared()) {
+		int n = other.elems_num;
+		if (&other != this)
+			combine(&JoinTree::unite, take(other), n, pool);
+	}
+
+	void intersect_with(const JoinTree &other, ThreadPool *pool = &ThreadPool::shared()) {
+		if (&other != this)
+			combine(&JoinTree::intersect, copyOf(other.root, other.elems_num), other.elems_num, pool);
+	}
+
+	void intersect_with(JoinTree &&other, ThreadPool *pool = &ThreadPool::shared()) {
+		int n = other.elems_num;
+		if (&other != this)
+			combine(&JoinTree::intersect, take(other), n, pool);
+	}
+
+	void difference_with(const JoinTree &other, ThreadPool *pool = &ThreadPool::shared()) {
+		if (&other == this)
+			this->clear();
+		else
+			combine(&JoinTree::subtract, copyOf(other.root, other.elems_num), other.elems_num, pool);
+	}
+
+	void difference_with(JoinTree &&other, ThreadPool *pool = &ThreadPool::shared()) {
+		int n = other.elems_num;
+		if (&other == this)
+			this->clear();
+		else
+			combine(&JoinTree::subtract, take(other), n, pool);
+	}
+};
+
+#endif /* JOINTREE_HPP */
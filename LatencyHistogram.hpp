@@ -0,0 +1,85 @@
+#ifndef LATENCYHISTOGRAM_HPP
+#define LATENCYHISTOGRAM_HPP
+
+#include <vector>
+#include <cstdint>
+#include <time.h>
+
+// Nanoseconds of the raw monotonic clock, which is not adjusted by NTP
+inline std::uint64_t getNanoTime() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+Histogram of latencies in the manner of HdrHistogram: the values below 2^(sub_bits + 1)
+have their own buckets, and every range from 2^k to 2^(k + 1) above is split into
+2^sub_bits equal buckets, so a percentile is off by 1/2^sub_bits of it at most.
+*/
+class LatencyHistogram {
+private:
+	static constexpr int sub_bits = 5;
+	static constexpr std::uint64_t sub = 1 << sub_bits;
+
+	std::vector<std::uint64_t> counts;
+	std::uint64_t total = 0;
+	std::uint64_t max_value = 0;
+
+	static std::size_t bucketOf(std::uint64_t value) {
+		if (value < 2 * sub)
+			return value;
+		int shift = 63 - __builtin_clzll(value) - sub_bits;
+		return (shift + 1) * sub + ((value >> shift) - sub);
+	}
+
+	// The largest value of the bucket
+	static std::uint64_t highestOf(std::size_t bucket) {
+		if (bucket < 2 * sub)
+			return bucket;
+		int shift = bucket / sub - 1;
+		return ((bucket % sub + sub) << shift) + ((std::uint64_t)1 << shift) - 1;
+	}
+
+public:
+	LatencyHistogram() : counts((65 - sub_bits) * sub) {}
+
+	void record(std::uint64_t value) {
+		counts[bucketOf(value)]++;
+		total++;
+		if (value > max_value)
+			max_value = value;
+	}
+
+	// The value which p percent of the recorded ones do not exceed
+	std::uint64_t percentile(double p) const {
+		if (total == 0)
+			return 0;
+		std::uint64_t rank = (std::uint64_t)(p / 100 * total + 0.5);
+		if (rank == 0)
+			rank = 1;
+		std::uint64_t seen = 0;
+		for (std::size_t i = 0; i < counts.size(); i++) {
+			seen += counts[i];
+			if (seen >= rank)
+				return (highestOf(i) < max_value ? highestOf(i) : max_value);
+		}
+		return max_value;
+	}
+
+	std::uint64_t max() const {
+		return max_value;
+	}
+
+	std::uint64_t count() const {
+		return total;
+	}
+
+	void clear() {
+		counts.assign(counts.size(), 0);
+		total = 0;
+		max_value = 0;
+	}
+};
+
+#endif /* LATENCYHISTOGRAM_HPP */
@@ -1,96 +1,157 @@
 #ifndef NODE_HPP
 #define NODE_HPP
 
-template< typename Data_t >
-class Node {
+#include <new>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+template< class Alloc, class = void >
+struct has_release : std::false_type {};
+
+template< class Alloc >
+struct has_release<Alloc, std::void_t<decltype(std::declval<Alloc&>().release())>> : std::true_type {};
+
+// The number of nodes in the subtree of a node, kept only if Counted is set
+template< bool Counted >
+struct NodeCount {
+	int subtree_size = 1;
+};
+
+template<>
+struct NodeCount<false> {};
+
+/*
+Aggregate of the elements in the subtree of a node, kept only if there is an aggregate policy.
+The policy gives the value_type, identity(), combine(a, b) and of(element), the value of one element.
+combine must be associative, but not necessarily commutative: the elements come in order.
+*/
+template< class Aggregate_t >
+struct NodeAggregate {
+	typename Aggregate_t::value_type aggregate;
+};
+
+template<>
+struct NodeAggregate<void> {};
+
+/*
+Tree node with TagBits of tree-specific state (the color of an RB node, the
+balance factor of an AVL node) packed into the low bits of the parent
+pointer. The root pointer is owned by the tree and passed to the methods
+which may change it.
+With Counted the node knows the size of its subtree, with an Aggregate_t
+policy the aggregate of its subtree. Rotations keep them, and the trees
+update them on the path of an insertion or a removal.
+*/
+template< typename Data_t, int TagBits, bool Counted = false, class Aggregate_t = void >
+class Node : private NodeCount<Counted>, private NodeAggregate<Aggregate_t> {
 private:
+	static const std::uintptr_t tag_mask = (std::uintptr_t(1) << TagBits) - 1;
+
 	Node *left = nullptr;
 	Node *right = nullptr;
-	Node *parent = nullptr;
-	int height = 1;
-	Node **root;
+	std::uintptr_t parent_tag = 0;
 
-	Node **getBindingPoint() const {
-		if (parent == nullptr)
-			return root;
-
-		if (this == parent->left)
-			return &parent->left;
-		else if (this == parent->right)
-			return &parent->right;
-		else
-			throw 1;
+	template< class... Args >
+	Node(Args&&... args) : data(std::forward<Args>(args)...) {
+		update();
 	}
 
-	Node(const Data_t &data) {
-		this->data = data;
-	}
-
-	~Node() {
-		if (left != nullptr)
-			delete left;
-		if (right != nullptr)
-			delete right;
+	void setParent(Node *parent) {
+		parent_tag = reinterpret_cast<std::uintptr_t>(parent) | (parent_tag & tag_mask);
 	}
 
 public:
-	Data_t data;
-
-	static void createRoot(const Data_t &data, Node **root) {
-		if (*root != nullptr)
-			throw 1;
+	typedef Data_t data_type;
+	static constexpr bool counted = Counted;
+	static constexpr bool aggregated = !std::is_void<Aggregate_t>::value;
+	typedef Aggregate_t aggregate_type;
 
-		Node *new_node = new Node(data);
-		new_node->root = root;
-		*root = new_node;
-	}
+	Data_t data;
 
-	void updateHeight() {
-		if (left == nullptr) {
-			if (right == nullptr)
-				height = 1;
-			else
-				height = right->height + 1;
+	// Constructs the data in place from the arguments
+	template< class Alloc, class... Args >
+	static Node *create(Alloc &alloc, Args&&... args) {
+		static_assert(alignof(Node) > tag_mask, "No spare bits in the parent pointer");
+		Node *p = alloc.allocate(1);
+		try {
+			new (p) Node(std::forward<Args>(args)...);
 		}
-		else {
-			if (right == nullptr)
-				height = left->height + 1;
-			else
-				height = left->height > right->height ? left->height + 1 : right->height + 1;
+		catch (...) {
+			alloc.deallocate(p, 1);
+			throw;
 		}
+		return p;
 	}
 
-	void createLeft(const Data_t &data) {
-		if (left != nullptr)
-			throw 1;
+	/*
+	Destroys the node together with its subtree in one pass without recursion:
+	left children are rotated up until there are none, then the node is freed
+	and the walk goes on to the right.
+	*/
+	template< class Alloc >
+	static void destroy(Node *node, Alloc &alloc) {
+		while (node != nullptr) {
+			Node *next;
+			if (node->left != nullptr) {
+				next = node->left;
+				node->left = next->right;
+				next->right = node;
+			}
+			else {
+				next = node->right;
+				node->~Node();
+				alloc.deallocate(node, 1);
+			}
+			node = next;
+		}
+	}
 
-		Node *new_node = new Node(data);
-		new_node->root = root;
-		new_node->parent = this;
-		left = new_node;
+	/*
+	Destroys the whole tree. If nothing has to be done to destroy a node and the
+	allocator can give all its memory back at once, the nodes are not visited.
+	The allocator must serve only this tree then.
+	*/
+	template< class Alloc >
+	static void destroyAll(Node *root, Alloc &alloc) {
+		if constexpr (std::is_trivially_destructible<Node>::value && has_release<Alloc>::value)
+			alloc.release();
+		else if (root != nullptr)
+			destroy(root, alloc);
+	}
 
-		for (Node *p = this; p != nullptr; p = p->parent)
-			p->updateHeight();
+	// Height of the subtree, walks all of it
+	static int height(const Node *node) {
+		if (node == nullptr)
+			return 0;
+		int lh = height(node->left), rh = height(node->right);
+		return (lh > rh ? lh : rh) + 1;
 	}
 
-	void createRight(const Data_t &data) {
-		if (right != nullptr)
-			throw 1;
+	static int subtreeSize(const Node *node) {
+		static_assert(Counted, "The nodes do not count their subtrees");
+		return (node == nullptr ? 0 : node->subtree_size);
+	}
 
-		Node *new_node = new Node(data);
-		new_node->root = root;
-		new_node->parent = this;
-		right = new_node;
+	template< class A = Aggregate_t >
+	static typename A::value_type aggregateOf(const Node *node) {
+		return (node == nullptr ? A::identity() : node->aggregate);
+	}
 
-		for (Node *p = this; p != nullptr; p = p->parent)
-			p->updateHeight();
+	// Takes the size and the aggregate of the subtree from the children
+	void update() {
+		if constexpr (Counted)
+			this->subtree_size = subtreeSize(left) + subtreeSize(right) + 1;
+		if constexpr (aggregated)
+			this->aggregate = Aggregate_t::combine(Aggregate_t::combine(aggregateOf(left), Aggregate_t::of(data)),
+				aggregateOf(right));
 	}
 
-	void remove() {
-		*getBindingPoint() = nullptr;
-		for (Node *p = parent; p != nullptr; p = p->parent)
-			p->updateHeight();
-		delete this;
+	// The same for the node and all its ancestors
+	void updateUp() {
+		if constexpr (Counted || aggregated)
+			for (Node *node = this; node != nullptr; node = node->getParent())
+				node->update();
 	}
 
 	Node *getLeft() const {
@@ -101,116 +162,162 @@ public:
 		return right;
 	}
 
-	int getHeight() const {
-		return height;
+	Node *getParent() const {
+		return reinterpret_cast<Node*>(parent_tag & ~tag_mask);
 	}
 
-	Node *getParent() const {
+	unsigned getTag() const {
+		return parent_tag & tag_mask;
+	}
+
+	void setTag(unsigned tag) {
+		parent_tag = (parent_tag & ~tag_mask) | tag;
+	}
+
+	static Node *leftmost(Node *node) {
+		while (node->left != nullptr)
+			node = node->left;
+		return node;
+	}
+
+	static Node *rightmost(Node *node) {
+		while (node->right != nullptr)
+			node = node->right;
+		return node;
+	}
+
+	// The next node in order or null
+	Node *next() {
+		if (right != nullptr)
+			return leftmost(right);
+		Node *node = this, *parent = getParent();
+		while (parent != nullptr && node == parent->right) {
+			node = parent;
+			parent = parent->getParent();
+		}
+		return parent;
+	}
+
+	// The previous node in order or null
+	Node *prev() {
+		if (left != nullptr)
+			return rightmost(left);
+		Node *node = this, *parent = getParent();
+		while (parent != nullptr && node == parent->left) {
+			node = parent;
+			parent = parent->getParent();
+		}
 		return parent;
 	}
 
 	bool isLeft() const {
+		Node *parent = getParent();
 		// Root
 		if (parent == nullptr)
 			return false;
-
-		if (this == parent->left)
-			return true;
-		return false;
+		return this == parent->left;
 	}
 
 	bool isRight() const {
+		Node *parent = getParent();
 		// Root
 		if (parent == nullptr)
 			return false;
-
-		if (this == parent->right)
-			return true;
-		return false;
+		return this == parent->right;
 	}
 
 	bool isRoot() const {
+		return getParent() == nullptr;
+	}
+
+	Node **getBindingPoint(Node **root) {
+		Node *parent = getParent();
 		if (parent == nullptr)
-			return true;
-		return false;
+			return root;
+
+		if (this == parent->left)
+			return &parent->left;
+		else if (this == parent->right)
+			return &parent->right;
+		else
+			throw 1;
 	}
 
-	void bindToLeft(Node &node) {
-		Node *tmp = node.left;
+	void setLeft(Node *node) {
+		left = node;
+		if (node != nullptr)
+			node->setParent(this);
+	}
 
-		*getBindingPoint() = nullptr;
-		parent = &node;
-		node.left = this;
-		for (Node *p = parent; p != nullptr; p = p->parent)
-			p->updateHeight();
-		if (tmp != nullptr)
-			delete tmp;
+	void setRight(Node *node) {
+		right = node;
+		if (node != nullptr)
+			node->setParent(this);
 	}
 
-	void bindToRight(Node &node) {
-		Node *tmp = node.right;
+	// Takes the left subtree off, it becomes a tree of its own
+	Node *cutLeft() {
+		Node *node = left;
+		left = nullptr;
+		if (node != nullptr)
+			node->setParent(nullptr);
+		return node;
+	}
 
-		*getBindingPoint() = nullptr;
-		parent = &node;
-		node.right = this;
-		for (Node *p = parent; p != nullptr; p = p->parent)
-			p->updateHeight();
-		if (tmp != nullptr)
-			delete tmp;
+	Node *cutRight() {
+		Node *node = right;
+		right = nullptr;
+		if (node != nullptr)
+			node->setParent(nullptr);
+		return node;
 	}
 
-	void bindToRoot() {
-		Node *tmp = *root;
+	/*
+	Moves the node, which must be unlinked, to the place of this one. It takes over
+	the children and the tag of this node, and this one becomes unlinked.
+	*/
+	void substituteBy(Node *node, Node **root) {
+		*getBindingPoint(root) = node;
+		node->parent_tag = parent_tag;
+		node->setLeft(left);
+		node->setRight(right);
+		left = right = nullptr;
+	}
 
-		*getBindingPoint() = nullptr;
-		parent = nullptr;
-		*root = this;
-		if (tmp != nullptr)
-			delete tmp;
+	// Puts the node (possibly null) to the place of this one, which becomes unlinked
+	void replaceBy(Node *node, Node **root) {
+		*getBindingPoint(root) = node;
+		if (node != nullptr)
+			node->setParent(getParent());
+		left = right = nullptr;
 	}
 
-	void rotateRight() {
+	void rotateRight(Node **root) {
 		Node *left = this->left;
 		if (left == nullptr)
 			throw 1;
 
-		Node *parent = this->parent;
-		Node **p = this->getBindingPoint();
-
-		this->left = left->right;
-		if (left->right != nullptr)
-			left->right->parent = this;
-
-		left->right = this;
-		this->parent = left;
+		*getBindingPoint(root) = left;
+		left->setParent(getParent());
 
-		*p = left;
-		left->parent = parent;
-
-		this->updateHeight();
-		left->updateHeight();
+		setLeft(left->right);
+		left->setRight(this);
+		update();
+		left->update();
 	}
 
-	void rotateLeft() {
+	void rotateLeft(Node **root) {
 		Node *right = this->right;
 		if (right == nullptr)
 			throw 1;
 
-		Node *parent = this->parent;
-		Node **p = this->getBindingPoint();
-
-		this->right = right->left;
-		if (right->left != nullptr)
-			right->left->parent = this;
-
-		right->left = this;
-		this->parent = right;
-
-		*p = right;
-		right->parent = parent;
+		*getBindingPoint(root) = right;
+		right->setParent(getParent());
 
-		this->updateHeight();
-		right->updateHeight();
+		setRight(right->left);
+		right->setLeft(this);
+		update();
+		right->update();
 	}
 };
 
@@ -0,0 +1,332 @@
+#ifndef PERSISTENTTREE_HPP
+#define PERSISTENTTREE_HPP
+
+#include <functional>
+#include <utility>
+#include <iostream>
+#include <queue>
+#include <atomic>
+#include <cstddef>
+
+#include "TreeBase.hpp"
+
+/*
+AVL set whose versions share their nodes. A change copies the nodes on its path which
+another version also refers to and keeps the others, so snapshot() is O(1) and a change
+costs O(log n) new nodes at most. The nodes have no parent pointers and count the links
+to them, and a node is freed with the last version which uses it. While no snapshot
+shares the path, the nodes are changed in place as in a mutable tree.
+Versions may be read and dropped on any threads, each of them changed on one thread.
+*/
+template< class Key_t, class Compare_t = std::less<Key_t> >
+class PersistentTree : public TreeBase<Key_t, Compare_t> {
+private:
+	struct Node {
+		Key_t key;
+		Node *left, *right;
+		std::atomic<int> refs{1};
+		int height;
+
+		Node(const Key_t &key, Node *left = nullptr, Node *right = nullptr)
+				: key(key), left(left), right(right), height(1) {
+			live_nodes++;
+		}
+
+		~Node() {
+			live_nodes--;
+		}
+	};
+
+	static inline std::atomic<long> live_nodes{0};
+
+	Node *root = nullptr;
+	int elems_num = 0;
+	Compare_t comp;
+
+	static int height(const Node *node) {
+		return (node == nullptr ? 0 : node->height);
+	}
+
+	static void update(Node *node) {
+		int lh = height(node->left), rh = height(node->right);
+		node->height = (lh > rh ? lh : rh) + 1;
+	}
+
+	static Node *retain(Node *node) {
+		if (node != nullptr)
+			node->refs.fetch_add(1, std::memory_order_relaxed);
+		return node;
+	}
+
+	static void release(Node *node) {
+		if (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			release(node->left);
+			release(node->right);
+			delete node;
+		}
+	}
+
+	/*
+	The node itself if only one link leads to it, otherwise its copy. The link
+	the node came from must be replaced by the result.
+	*/
+	static Node *own(Node *node) {
+		if (node->refs.load(std::memory_order_acquire) == 1)
+			return node;
+		Node *copy = new Node(node->key, retain(node->left), retain(node->right));
+		copy->height = node->height;
+		release(node);
+		return copy;
+	}
+
+	static Node *rotateLeft(Node *node) {
+		Node *right = node->right = own(node->right);
+		node->right = right->left;
+		right->left = node;
+		update(node);
+		update(right);
+		return right;
+	}
+
+	static Node *rotateRight(Node *node) {
+		Node *left = node->left = own(node->left);
+		node->left = left->right;
+		left->right = node;
+		update(node);
+		update(left);
+		return left;
+	}
+
+	// The node and its path must be owned
+	static Node *balance(Node *node) {
+		int b = height(node->right) - height(node->left);
+		if (b == 2) {
+			if (height(node->right->right) < height(node->right->left)) {
+				node->right = own(node->right);
+				node->right = rotateRight(node->right);
+			}
+			return rotateLeft(node);
+		}
+		if (b == -2) {
+			if (height(node->left->left) < height(node->left->right)) {
+				node->left = own(node->left);
+				node->left = rotateLeft(node->left);
+			}
+			return rotateRight(node);
+		}
+		update(node);
+		return node;
+	}
+
+	// The key must be absent
+	Node *insert(Node *node, const Key_t &key) {
+		if (node == nullptr)
+			return new Node(key);
+		node = own(node);
+		if (comp(key, node->key))
+			node->left = insert(node->left, key);
+		else
+			node->right = insert(node->right, key);
+		return balance(node);
+	}
+
+	// Takes the smallest key of the subtree to "key"
+	static Node *eraseMin(Node *node, Key_t &key) {
+		node = own(node);
+		if (node->left == nullptr) {
+			Node *right = node->right;
+			key = std::move(node->key);
+			node->right = nullptr;
+			release(node);
+			return right;
+		}
+		node->left = eraseMin(node->left, key);
+		return balance(node);
+	}
+
+	// The key must be present
+	Node *erase(Node *node, const Key_t &key) {
+		node = own(node);
+		if (comp(key, node->key))
+			node->left = erase(node->left, key);
+		else if (comp(node->key, key))
+			node->right = erase(node->right, key);
+		else {
+			if (node->left == nullptr || node->right == nullptr) {
+				Node *child = (node->left == nullptr ? node->right : node->left);
+				node->left = node->right = nullptr;
+				release(node);
+				return child;
+			}
+			node->right = eraseMin(node->right, node->key);
+		}
+		return balance(node);
+	}
+
+	const Node *findNode(const Key_t &key) const {
+		const Node *node = root;
+		while (node != nullptr) {
+			if (comp(key, node->key))
+				node = node->left;
+			else if (comp(node->key, key))
+				node = node->right;
+			else
+				return node;
+		}
+		return nullptr;
+	}
+
+	template< class Function_t >
+	void for_each_rec(const Node *node, const Key_t &lo, const Key_t &hi, Function_t &f) const {
+		if (node == nullptr)
+			return;
+		if (comp(lo, node->key))
+			for_each_rec(node->left, lo, hi, f);
+		if (!comp(node->key, lo) && comp(node->key, hi))
+			f(node->key);
+		if (comp(node->key, hi))
+			for_each_rec(node->right, lo, hi, f);
+	}
+
+	int check_rec(const Node *node) const {
+		if (node == nullptr)
+			return 0;
+		if (node->refs.load() < 1)
+			throw "Tree is incorrect!";
+		if (node->left != nullptr && !comp(node->left->key, node->key))
+			throw "Tree is incorrect!";
+		if (node->right != nullptr && !comp(node->key, node->right->key))
+			throw "Tree is incorrect!";
+		int lh = check_rec(node->left), rh = check_rec(node->right);
+		if (lh - rh > 1 || rh - lh > 1 || node->height != (lh > rh ? lh : rh) + 1)
+			throw "Tree is incorrect!";
+		return node->height;
+	}
+
+public:
+	typedef Key_t key_type;
+
+	PersistentTree(const Compare_t &comp = Compare_t()) : comp(comp) {}
+
+	// The copy shares all the nodes, in O(1)
+	PersistentTree(const PersistentTree &other) : root(retain(other.root)), elems_num(other.elems_num), comp(other.comp) {}
+
+	PersistentTree(PersistentTree &&other) : root(other.root), elems_num(other.elems_num), comp(other.comp) {
+		other.root = nullptr;
+		other.elems_num = 0;
+	}
+
+	PersistentTree &operator=(const PersistentTree &other) {
+		Node *old = root;
+		root = retain(other.root);
+		elems_num = other.elems_num;
+		comp = other.comp;
+		release(old);
+		return *this;
+	}
+
+	PersistentTree &operator=(PersistentTree &&other) {
+		if (this != &other) {
+			release(root);
+			root = other.root;
+			elems_num = other.elems_num;
+			comp = other.comp;
+			other.root = nullptr;
+			other.elems_num = 0;
+		}
+		return *this;
+	}
+
+	~PersistentTree() {
+		release(root);
+	}
+
+	// The version as it is now, which the later changes of this tree do not touch
+	PersistentTree snapshot() const {
+		return *this;
+	}
+
+	// Nothing is copied for the keys which are already there
+	void insert(const Key_t &key) {
+		if (findNode(key) != nullptr)
+			return;
+		root = insert(root, key);
+		elems_num++;
+	}
+
+	void erase(const Key_t &key) {
+		if (findNode(key) == nullptr)
+			return;
+		root = erase(root, key);
+		elems_num--;
+	}
+
+	bool contains(const Key_t &key) const {
+		return findNode(key) != nullptr;
+	}
+
+	int size() const {
+		return elems_num;
+	}
+
+	void clear() {
+		release(root);
+		root = nullptr;
+		elems_num = 0;
+	}
+
+	template< class Function_t >
+	void for_each(const Key_t &lo, const Key_t &hi, Function_t f) const {
+		for_each_rec(root, lo, hi, f);
+	}
+
+	// The nodes of all the versions which are alive
+	static long liveNodes() {
+		return live_nodes;
+	}
+
+	static constexpr std::size_t nodeSize() {
+		return sizeof(Node);
+	}
+
+	void print() const {
+		if (root == nullptr)
+			return;
+		std::queue<const Node*> q;
+
+		int h = height(root);
+		int width = (1 << h) - 1;
+		q.push(root);
+		int pos_num = 1;
+		for (int j = 0; j < h; j++, pos_num = 2 * pos_num, width = width/2) {
+			for (int k = 0; k < width/2; k++)
+				std::cout << ' ';
+			for (int i = 0; i < pos_num; i++) {
+				if (i > 0)
+					for (int k = 0; k < width; k++)
+						std::cout << ' ';
+				const Node *node = q.front();
+				q.pop();
+				if (node == nullptr) {
+					std::cout << ' ';
+					q.push(nullptr);
+					q.push(nullptr);
+				}
+				else {
+					std::cout << node->key;
+					q.push(node->left);
+					q.push(node->right);
+				}
+			}
+			for (int k = 0; k < width/2; k++)
+				std::cout << ' ';
+			std::cout << '\n';
+		}
+	}
+
+	void check() const {
+		check_rec(root);
+	}
+};
+
+#endif /* PERSISTENTTREE_HPP */
@@ -0,0 +1,98 @@
+#ifndef POOLALLOCATOR_HPP
+#define POOLALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/*
+Slab allocator for tree nodes. Single objects are cut from contiguous chunks
+of ChunkSize slots; freed slots go to a free list and are handed out again
+before the chunk is advanced. Requests for more than one object fall through
+to the global heap.
+
+Every allocator owns its own pool: a copy starts empty and only the allocator
+which returned a pointer may take it back.
+*/
+template< class T, std::size_t ChunkSize = 1024 >
+class PoolAllocator {
+private:
+	union Slot {
+		Slot *next;
+		alignas(T) char storage[sizeof(T)];
+	};
+
+	std::vector<Slot*> chunks;
+	Slot *free_list = nullptr;
+	Slot *cur = nullptr;
+	Slot *end = nullptr;
+
+	template< class U, std::size_t N >
+	friend class PoolAllocator;
+
+public:
+	typedef T value_type;
+
+	template< class U >
+	struct rebind {
+		typedef PoolAllocator<U, ChunkSize> other;
+	};
+
+	PoolAllocator() {}
+
+	PoolAllocator(const PoolAllocator &) {}
+
+	template< class U >
+	PoolAllocator(const PoolAllocator<U, ChunkSize> &) {}
+
+	PoolAllocator &operator=(const PoolAllocator &) = delete;
+
+	~PoolAllocator() {
+		release();
+	}
+
+	T *allocate(std::size_t n) {
+		if (n != 1)
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+
+		if (free_list != nullptr) {
+			Slot *s = free_list;
+			free_list = s->next;
+			return reinterpret_cast<T*>(s);
+		}
+		if (cur == end) {
+			cur = static_cast<Slot*>(::operator new(ChunkSize * sizeof(Slot)));
+			end = cur + ChunkSize;
+			chunks.push_back(cur);
+		}
+		return reinterpret_cast<T*>(cur++);
+	}
+
+	void deallocate(T *p, std::size_t n) {
+		if (n != 1) {
+			::operator delete(p);
+			return;
+		}
+		Slot *s = reinterpret_cast<Slot*>(p);
+		s->next = free_list;
+		free_list = s;
+	}
+
+	// Gives all the chunks back to the heap at once. Objects are not destroyed.
+	void release() {
+		for (Slot *c : chunks)
+			::operator delete(c);
+		chunks.clear();
+		free_list = cur = end = nullptr;
+	}
+
+	bool operator==(const PoolAllocator &other) const {
+		return this == &other;
+	}
+
+	bool operator!=(const PoolAllocator &other) const {
+		return this != &other;
+	}
+};
+
+#endif /* POOLALLOCATOR_HPP */
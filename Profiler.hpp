@@ -7,9 +7,28 @@
 #include <algorithm>
 #include <string>
 #include <fstream>
+#include <string_view>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "getCPUTime.hpp"
+#include "allocCount.hpp"
+#include "perfCounters.hpp"
 #include "TreeBase.hpp"
+#include "AnyTree.hpp"
+#include "LatencyHistogram.hpp"
+#include "Workload.hpp"
+#include "Trace.hpp"
+#include "ThreadPool.hpp"
+#include "ConcurrentTree.hpp"
+#include "ShardedTree.hpp"
+#include "PersistentTree.hpp"
 
 using std::vector;
 using std::pair;
@@ -17,53 +36,160 @@ using std::random_shuffle;
 using std::string;
 using std::fstream;
 
-template< class Tree, class Generator = std::random_device >
+/*
+Makes the compiler think the value is read, so the lookups it comes from are made
+even if nothing else uses their results. The memory clobber keeps it in its place.
+*/
+template< class T >
+inline void doNotOptimize(const T &value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template< class Tree, class Generator = FastRandom >
 class Profiler {
+	static_assert(is_tree_v<Tree>, "Tree must have the interface of TreeBase");
+
 private:
 	vector<pair<int, double>> insertionStats;
 	vector<pair<int, double>> accessStats;
 	vector<pair<int, double>> deletionStats;
+	vector<double> memoryStats;
+	// The heap bytes per key and the peak RSS after every block of insertions
+	vector<pair<double, double>> heapStats;
+	// The heap allocations per operation of every block of measure
+	vector<double> insertionAllocs, accessAllocs, deletionAllocs;
+	// Hardware counters per operation of every block of measure, when they are used
+	vector<vector<double>> insertionCounters, accessCounters, deletionCounters;
+	std::unique_ptr<PerfCounters> counters;
+	vector<pair<int, double>> scanStats;
+	vector<pair<string, pair<double, double>>> allocStats;
+	vector<pair<string, double>> throughputStats;
+	vector<pair<int, double>> snapshotStats;
+	// The operation, the size and the latencies in ns at the percentiles below
+	vector<pair<string, vector<double>>> latencyStats;
+	static constexpr double percentiles[] = {50, 90, 99, 99.9, 100};
 	Generator rnd;
+
+	// Runs the operation on the tree; returns the keys found
+	static long long apply(Tree &tree, Operation op, const typename Tree::key_type &key, int scan_length) {
+		switch (op) {
+		case Operation::lookup:
+			return tree.contains(key);
+		case Operation::insert:
+			tree.insert(key);
+			break;
+		case Operation::erase:
+			tree.erase(key);
+			break;
+		case Operation::scan: {
+			long long found = 0;
+			auto it = tree.lower_bound(key);
+			for (int i = 0; i < scan_length && it != tree.end(); i++, ++it)
+				found++;
+			return found;
+		}
+		case Operation::clear:
+			tree.clear();
+			break;
+		}
+		return 0;
+	}
+
+	void startCounters() {
+		if (counters)
+			counters->start();
+	}
+
+	// Called after the time and the allocations are taken, as it makes syscalls and allocates
+	void stopCounters(vector<vector<double>> &stats, int ops) {
+		if (!counters)
+			return;
+		vector<double> values = counters->stop();
+		for (double &v : values)
+			v /= ops;
+		stats.push_back(values);
+	}
+
+	void writeCounterNames(fstream &f, const string &prefix) const {
+		if (counters)
+			for (auto &name : counters->names())
+				f << '\t' << prefix << name;
+	}
+
+	void writeCounters(fstream &f, const vector<vector<double>> &stats, std::size_t row) const {
+		if (counters)
+			for (double v : stats[row])
+				f << '\t' << v;
+	}
+
 public:
 	Profiler() : rnd() {}
 	Profiler(const Generator &g) : rnd(g) {}
 
+	/*
+	Makes measure read the hardware counters around every block and save them as more columns.
+	Returns false if no counter is available, then only the time is measured.
+	*/
+	bool useCounters() {
+		counters.reset(new PerfCounters);
+		if (counters->names().empty())
+			counters.reset();
+		return counters != nullptr;
+	}
+
 	void measure(int max_size, int cicles = 10000) {
 		Tree tree;
 		// Fill a buffer by random numbers in advance
 		typename Tree::key_type *random_elems = new typename Tree::key_type[max_size + cicles];
 		for (int i = 0; i < max_size + cicles; i++)
 			random_elems[i] = rnd();
+		// All the heap taken from here on is the tree's
+		long long base_bytes = getLiveBytes();
+		resetPeakRSS();
 
 		int n = 0;
 		while (tree.size() < max_size && n < max_size) {
 			int start_size = tree.size();
 			double start, stop;
+			startCounters();
+			long long allocs = getAllocCount();
 			start = getCPUTime();
 
 			for (int i = 0; i < cicles; i++)
 				tree.insert(random_elems[n++]);
 
 			stop = getCPUTime();
+			allocs = getAllocCount() - allocs;
+			stopCounters(insertionCounters, cicles);
+			insertionAllocs.push_back((double)allocs/cicles);
 			int end_size = tree.size();
 			if (start < 0 || stop < 0)
 				throw 1;
 			insertionStats.push_back(pair{(end_size + start_size)/2, (stop - start)/cicles});
+			memoryStats.push_back((double)tree.memoryUsage()/end_size);
+			heapStats.push_back({(double)(getLiveBytes() - base_bytes)/end_size, (double)getPeakRSS()});
 		}
 
 		random_shuffle(random_elems, random_elems + max_size + cicles);
 
 		n = 0;
+		long long found = 0;
 		while (tree.size() > 0 && n < max_size) {
 			int start_size = tree.size();
 			double start, stop;
 
+			startCounters();
+			long long allocs = getAllocCount();
 			start = getCPUTime();
 
 			for (int i = 0; i < cicles; i++)
-				tree.contains(random_elems[n++]);
+				found += tree.contains(random_elems[n++]);
+			doNotOptimize(found);
 
 			stop = getCPUTime();
+			allocs = getAllocCount() - allocs;
+			stopCounters(accessCounters, cicles);
+			accessAllocs.push_back((double)allocs/cicles);
 			int end_size = tree.size();
 			if (start < 0 || stop < 0)
 				throw 1;
@@ -71,12 +197,17 @@ public:
 
 			n -= cicles;
 
+			startCounters();
+			allocs = getAllocCount();
 			start = getCPUTime();
 
 			for (int i = 0; i < cicles; i++)
 				tree.erase(random_elems[n++]);
 
 			stop = getCPUTime();
+			allocs = getAllocCount() - allocs;
+			stopCounters(deletionCounters, cicles);
+			deletionAllocs.push_back((double)allocs/cicles);
 			end_size = tree.size();
 			if (start < 0 || stop < 0)
 				throw 1;
@@ -86,21 +217,791 @@ public:
 		delete[] random_elems;
 	}
 
+	// Range scan throughput in keys per second for every scan length
+	void measureScan(int size, const vector<int> &lengths, int scans = 1000) {
+		Tree tree;
+		for (int i = 0; i < size; i++)
+			tree.insert(rnd());
+		vector<typename Tree::key_type> keys(tree.begin(), tree.end());
+
+		for (int len : lengths) {
+			if (len >= (int)keys.size())
+				break;
+			// Bounds are taken from the stored keys so that every scan visits exactly len keys
+			std::mt19937 pick(len);
+			vector<int> starts(scans);
+			for (int i = 0; i < scans; i++)
+				starts[i] = pick() % (keys.size() - len);
+
+			long long visited = 0;
+			double start, stop;
+			start = getCPUTime();
+
+			for (int i = 0; i < scans; i++)
+				tree.for_each(keys[starts[i]], keys[starts[i] + len], [&visited](const typename Tree::key_type &) {
+					visited++;
+				});
+
+			stop = getCPUTime();
+			if (start < 0 || stop < 0 || visited != (long long)len * scans)
+				throw 1;
+			scanStats.push_back(pair{len, visited/(stop - start)});
+		}
+	}
+
+	/*
+	Heap allocations and time per operation on a map when the elements are copied in
+	and when they are built in place. The mapped values are value_len long.
+	*/
+	void measureMap(int size, int value_len) {
+		vector<typename Tree::key_type> keys(size);
+		for (int i = 0; i < size; i++)
+			keys[i] = rnd();
+		const typename Tree::mapped_type value(value_len, 'x');
+
+		{
+			Tree tree;
+			long long allocs = getAllocCount();
+			double start = getCPUTime();
+
+			for (int i = 0; i < size; i++) {
+				typename Tree::value_type elem(keys[i], value);
+				tree.insert(elem);
+			}
+
+			double stop = getCPUTime();
+			if (start < 0 || stop < 0)
+				throw 1;
+			allocStats.push_back({"copy", {(double)(getAllocCount() - allocs)/size, (stop - start)/size}});
+		}
+
+		Tree tree;
+		long long allocs = getAllocCount();
+		double start = getCPUTime();
+
+		for (int i = 0; i < size; i++)
+			tree.try_emplace(keys[i], value_len, 'x');
+
+		double stop = getCPUTime();
+		if (start < 0 || stop < 0)
+			throw 1;
+		allocStats.push_back({"try_emplace", {(double)(getAllocCount() - allocs)/size, (stop - start)/size}});
+
+		allocs = getAllocCount();
+		start = getCPUTime();
+
+		for (int i = 0; i < size; i++)
+			tree.erase(keys[i]);
+
+		stop = getCPUTime();
+		if (start < 0 || stop < 0)
+			throw 1;
+		allocStats.push_back({"erase", {(double)(getAllocCount() - allocs)/size, (stop - start)/size}});
+	}
+
+	/*
+	Heap allocations and time per lookup in a string keyed tree with a transparent comparator,
+	when the probe is turned into a temporary key and when it is looked up as it is.
+	*/
+	void measureBorrowedLookup(int size) {
+		Tree tree;
+		vector<string> keys(size);
+		for (int i = 0; i < size; i++) {
+			keys[i] = rnd();
+			tree.insert(keys[i]);
+		}
+		vector<const char*> probes(size);
+		for (int i = 0; i < size; i++)
+			probes[i] = keys[i].c_str();
+
+		int found = 0;
+		long long allocs = getAllocCount();
+		double start = getCPUTime();
+
+		for (int i = 0; i < size; i++)
+			found += tree.contains(string(probes[i]));
+
+		double stop = getCPUTime();
+		if (start < 0 || stop < 0)
+			throw 1;
+		allocStats.push_back({"temporary", {(double)(getAllocCount() - allocs)/size, (stop - start)/size}});
+
+		allocs = getAllocCount();
+		start = getCPUTime();
+
+		for (int i = 0; i < size; i++)
+			found -= tree.contains(std::string_view(probes[i]));
+
+		stop = getCPUTime();
+		if (start < 0 || stop < 0 || found != 0)
+			throw 1;
+		allocStats.push_back({"borrowed", {(double)(getAllocCount() - allocs)/size, (stop - start)/size}});
+	}
+
+	/*
+	Heap allocations and time per element to fill a tree from scratch by repeated insertion
+	and by the bulk build from unsorted and from sorted input.
+	*/
+	void measureBuild(int size) {
+		vector<typename Tree::key_type> keys(size);
+		for (int i = 0; i < size; i++)
+			keys[i] = rnd();
+		vector<typename Tree::key_type> sorted(keys);
+		std::sort(sorted.begin(), sorted.end());
+		sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+		int built_size;
+		{
+			Tree tree;
+			long long allocs = getAllocCount();
+			double start = getCPUTime();
+
+			for (int i = 0; i < size; i++)
+				tree.insert(keys[i]);
+
+			double stop = getCPUTime();
+			if (start < 0 || stop < 0)
+				throw 1;
+			built_size = tree.size();
+			allocStats.push_back({"insert", {(double)(getAllocCount() - allocs)/size, (stop - start)/size}});
+		}
+		{
+			Tree tree;
+			long long allocs = getAllocCount();
+			double start = getCPUTime();
+
+			tree.build(keys.begin(), keys.end());
+
+			double stop = getCPUTime();
+			if (start < 0 || stop < 0 || tree.size() != built_size)
+				throw 1;
+			allocStats.push_back({"build_unsorted", {(double)(getAllocCount() - allocs)/size, (stop - start)/size}});
+		}
+		Tree tree;
+		long long allocs = getAllocCount();
+		double start = getCPUTime();
+
+		tree.build(sorted.begin(), sorted.end());
+
+		double stop = getCPUTime();
+		if (start < 0 || stop < 0 || tree.size() != built_size)
+			throw 1;
+		allocStats.push_back({"build_sorted", {(double)(getAllocCount() - allocs)/size, (stop - start)/size}});
+	}
+
+	// Lookups per second of the keys one by one and in batches of batch_size, half of them are present
+	void measureBatch(int size, int batch_size = 256) {
+		Tree tree;
+		vector<typename Tree::key_type> keys(size);
+		for (int i = 0; i < size; i++) {
+			keys[i] = rnd();
+			if (i % 2 == 0)
+				tree.insert(keys[i]);
+		}
+		random_shuffle(keys.begin(), keys.end());
+
+		long long found = 0;
+		double start = getCPUTime();
+
+		for (int i = 0; i < size; i++)
+			found += tree.contains(keys[i]);
+
+		double stop = getCPUTime();
+		if (start < 0 || stop < 0)
+			throw 1;
+		throughputStats.push_back({"single", size/(stop - start)});
+
+		std::unique_ptr<bool[]> out(new bool[batch_size]);
+		start = getCPUTime();
+
+		for (int i = 0; i < size; i += batch_size) {
+			int n = std::min(batch_size, size - i);
+			tree.contains_batch(&keys[i], n, out.get());
+			for (int j = 0; j < n; j++)
+				found -= out[j];
+		}
+
+		stop = getCPUTime();
+		if (start < 0 || stop < 0 || found != 0)
+			throw 1;
+		throughputStats.push_back({"batched", size/(stop - start)});
+	}
+
+	/*
+	Lookups per second in the tree and in its frozen snapshot, half of the keys are present.
+	The "freeze" row is how many keys per second go to the snapshot when it is rebuilt.
+	*/
+	void measureFrozen(int size) {
+		Tree tree;
+		vector<typename Tree::key_type> keys(size);
+		for (int i = 0; i < size; i++) {
+			keys[i] = rnd();
+			if (i % 2 == 0)
+				tree.insert(keys[i]);
+		}
+		random_shuffle(keys.begin(), keys.end());
+
+		long long found = 0;
+		double start = getCPUTime();
+
+		for (int i = 0; i < size; i++)
+			found += tree.contains(keys[i]);
+
+		double stop = getCPUTime();
+		if (start < 0 || stop < 0)
+			throw 1;
+		throughputStats.push_back({"live", size/(stop - start)});
+
+		start = getCPUTime();
+		auto frozen = tree.freeze();
+		stop = getCPUTime();
+		if (start < 0 || stop < 0 || frozen.size() != tree.size())
+			throw 1;
+		throughputStats.push_back({"freeze", tree.size()/(stop - start)});
+
+		start = getCPUTime();
+
+		for (int i = 0; i < size; i++)
+			found -= frozen.contains(keys[i]);
+
+		stop = getCPUTime();
+		if (start < 0 || stop < 0 || found != 0)
+			throw 1;
+		throughputStats.push_back({"frozen", size/(stop - start)});
+	}
+
+	/*
+	Time per element to merge a tree of "size" random keys into another one: by inserting the
+	keys one by one and by union_with on pools of 1, 2, 4... threads up to the number of cores.
+	The CPU time would count all the threads together, so the wall time is taken.
+	*/
+	void measureUnion(int size) {
+		vector<typename Tree::key_type> a(size), b(size);
+		for (int i = 0; i < size; i++) {
+			a[i] = rnd();
+			b[i] = rnd();
+		}
+		Tree other;
+		other.build(b.begin(), b.end());
+
+		int merged_size;
+		{
+			Tree tree;
+			tree.build(a.begin(), a.end());
+			long long allocs = getAllocCount();
+			auto start = std::chrono::steady_clock::now();
+
+			for (auto &key : other)
+				tree.insert(key);
+
+			std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+			merged_size = tree.size();
+			allocStats.push_back({"insert", {(double)(getAllocCount() - allocs)/size, time.count()/size}});
+		}
+
+		unsigned cores = std::thread::hardware_concurrency();
+		for (unsigned threads = 1; threads <= cores || threads == 1; threads *= 2) {
+			ThreadPool pool(threads);
+			Tree tree;
+			tree.build(a.begin(), a.end());
+			long long allocs = getAllocCount();
+			auto start = std::chrono::steady_clock::now();
+
+			tree.union_with(other, &pool);
+
+			std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+			if (tree.size() != merged_size)
+				throw 1;
+			allocStats.push_back({"union_" + std::to_string(threads), {(double)(getAllocCount() - allocs)/size, time.count()/size}});
+		}
+	}
+
+	/*
+	Operations per second on 1, 2, 4... threads up to the number of cores, 95% of them lookups
+	and 5% inserts and erases, over a tree of "size" random keys. The tree behind one mutex
+	("mutex_N") is compared with ConcurrentTree ("concurrent_N"). Every thread does "size"
+	operations, starting at its own place in the keys.
+	*/
+	void measureConcurrent(int size) {
+		vector<typename Tree::key_type> keys(size);
+		for (int i = 0; i < size; i++)
+			keys[i] = rnd();
+
+		auto run = [&keys, size](unsigned threads, auto contains, auto insert, auto erase) {
+			std::atomic<long long> found{0};
+			vector<std::thread> workers;
+			auto start = std::chrono::steady_clock::now();
+			for (unsigned t = 0; t < threads; t++)
+				workers.emplace_back([&, t]() {
+					long long local = 0;
+					for (int i = 0, k = (long long)t * size / threads; i < size; i++, k = (k + 1 == size ? 0 : k + 1))
+						if (i % 20 != 0)
+							local += contains(keys[k]);
+						else if (i % 40 == 0)
+							insert(keys[k]);
+						else
+							erase(keys[k]);
+					found += local;
+				});
+			for (auto &w : workers)
+				w.join();
+			std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+			if (found < 0)
+				throw 1;
+			return (double)threads * size/time.count();
+		};
+
+		unsigned cores = std::thread::hardware_concurrency();
+		for (unsigned threads = 1; threads <= cores || threads == 1; threads *= 2) {
+			Tree tree;
+			std::mutex m;
+			for (int i = 0; i < size; i += 2)
+				tree.insert(keys[i]);
+			throughputStats.push_back({"mutex_" + std::to_string(threads), run(threads,
+				[&](const typename Tree::key_type &key) {
+					std::lock_guard<std::mutex> lock(m);
+					return tree.contains(key);
+				},
+				[&](const typename Tree::key_type &key) {
+					std::lock_guard<std::mutex> lock(m);
+					tree.insert(key);
+				},
+				[&](const typename Tree::key_type &key) {
+					std::lock_guard<std::mutex> lock(m);
+					tree.erase(key);
+				})});
+		}
+		for (unsigned threads = 1; threads <= cores || threads == 1; threads *= 2) {
+			ConcurrentTree<Tree> tree;
+			for (int i = 0; i < size; i += 2)
+				tree.insert(keys[i]);
+			throughputStats.push_back({"concurrent_" + std::to_string(threads), run(threads,
+				[&](const typename Tree::key_type &key) {
+					return tree.contains(key);
+				},
+				[&](const typename Tree::key_type &key) {
+					tree.insert(key);
+				},
+				[&](const typename Tree::key_type &key) {
+					tree.erase(key);
+				})});
+		}
+	}
+
+	/*
+	Inserts per second of "size" random keys on 1, 2, 4... threads up to the number of cores,
+	each thread with its own part of the keys: into the tree behind one mutex ("mutex_N")
+	and into ShardedTree ("sharded_N"). Then the same keys in order are inserted into
+	ShardedTree ("sharded_sorted_N"), as the timestamps are, which keeps one shard growing.
+	*/
+	void measureSharded(int size) {
+		vector<typename Tree::key_type> keys(size);
+		for (int i = 0; i < size; i++)
+			keys[i] = rnd();
+
+		auto run = [&keys, size](unsigned threads, auto insert) {
+			vector<std::thread> workers;
+			auto start = std::chrono::steady_clock::now();
+			for (unsigned t = 0; t < threads; t++)
+				workers.emplace_back([&, t]() {
+					for (int i = (long long)t * size / threads; i < (long long)(t + 1) * size / threads; i++)
+						insert(keys[i]);
+				});
+			for (auto &w : workers)
+				w.join();
+			std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+			return size/time.count();
+		};
+
+		unsigned cores = std::thread::hardware_concurrency();
+		for (unsigned threads = 1; threads <= cores || threads == 1; threads *= 2) {
+			Tree tree;
+			std::mutex m;
+			throughputStats.push_back({"mutex_" + std::to_string(threads), run(threads,
+				[&](const typename Tree::key_type &key) {
+					std::lock_guard<std::mutex> lock(m);
+					tree.insert(key);
+				})});
+		}
+		for (string method : {"sharded_", "sharded_sorted_"}) {
+			if (method == "sharded_sorted_")
+				std::sort(keys.begin(), keys.end(), typename Tree::key_compare());
+			for (unsigned threads = 1; threads <= cores || threads == 1; threads *= 2) {
+				ShardedTree<Tree> tree;
+				throughputStats.push_back({method + std::to_string(threads), run(threads,
+					[&](const typename Tree::key_type &key) {
+						tree.insert(key);
+					})});
+				tree.check();
+			}
+		}
+	}
+
+	/*
+	Allocations and time per insert of "size" random keys: into the tree, into PersistentTree
+	and into PersistentTree with a snapshot taken before every insert, so its path is copied.
+	Then the bytes per key of all the live versions of the persistent tree are found with
+	0, 1, 10... 10000 snapshots, each of them taken before another insert.
+	*/
+	void measurePersistent(int size, int max_snapshots = 10000) {
+		typedef PersistentTree<typename Tree::key_type, typename Tree::key_compare> persistent_t;
+		vector<typename Tree::key_type> keys(size);
+		for (int i = 0; i < size; i++)
+			keys[i] = rnd();
+
+		auto run = [this, &keys, size](const string &method, auto insert) {
+			long long allocs = getAllocCount();
+			double start = getCPUTime();
+
+			for (int i = 0; i < size; i++)
+				insert(keys[i]);
+
+			double stop = getCPUTime();
+			if (start < 0 || stop < 0)
+				throw 1;
+			allocStats.push_back({method, {(double)(getAllocCount() - allocs)/size, (stop - start)/size}});
+		};
+
+		{
+			Tree tree;
+			run("insert", [&tree](const typename Tree::key_type &key) {
+				tree.insert(key);
+			});
+		}
+		{
+			persistent_t tree;
+			run("persistent", [&tree](const typename Tree::key_type &key) {
+				tree.insert(key);
+			});
+		}
+		persistent_t tree, last;
+		run("path_copy", [&tree, &last](const typename Tree::key_type &key) {
+			last = tree.snapshot();
+			tree.insert(key);
+		});
+		last.clear();
+
+		vector<persistent_t> snapshots;
+		for (int s = 0, next = 0; s <= max_snapshots; s++) {
+			if (s == next) {
+				snapshotStats.push_back({s, (double)persistent_t::liveNodes() * persistent_t::nodeSize()/tree.size()});
+				next = (next == 0 ? 1 : 10 * next);
+			}
+			snapshots.push_back(tree.snapshot());
+			tree.insert(rnd());
+		}
+	}
+
+	/*
+	Lookups per second made by "calls" calls to contains() of a tree of tree_size keys, small
+	enough to stay in the cache: on the tree type itself, inlined ("static"), and through
+	AnyTree, a virtual call each ("virtual"). Without optimization nothing is inlined, so
+	the difference shows only in the Release build.
+	*/
+	void measureDispatch(int calls, int tree_size = 1024) {
+		typedef typename Tree::key_type key_type;
+		Tree tree;
+		AnyTree<key_type, typename Tree::key_compare> any(std::in_place_type<Tree>);
+		vector<key_type> keys(2 * tree_size);
+		for (auto &key : keys) {
+			key = rnd();
+			if (&key - keys.data() < tree_size) {
+				tree.insert(key);
+				any.insert(key);
+			}
+		}
+		// The lookups found are counted in advance, so they cannot be thrown away by the optimizer
+		typename Tree::key_compare comp;
+		vector<key_type> present(keys.begin(), keys.begin() + tree_size);
+		std::sort(present.begin(), present.end(), comp);
+		random_shuffle(keys.begin(), keys.end());
+		long long expected = 0;
+		for (int i = 0, k = 0; i < calls; i++, k = (k + 1 == (int)keys.size() ? 0 : k + 1))
+			expected += std::binary_search(present.begin(), present.end(), keys[k], comp);
+
+		auto run = [this, &keys, calls, expected](const string &method, const auto &t) {
+			long long found = 0;
+			double start = getCPUTime();
+
+			for (int i = 0, k = 0; i < calls; i++, k = (k + 1 == (int)keys.size() ? 0 : k + 1))
+				found += t.contains(keys[k]);
+
+			double stop = getCPUTime();
+			if (start < 0 || stop < 0 || found != expected)
+				throw 1;
+			throughputStats.push_back({method, calls/(stop - start)});
+		};
+
+		run("static", tree);
+		run("virtual", any);
+	}
+
+	/*
+	Allocations and wall time per key to bring back a tree of "size" random keys: inserting
+	them in random order ("insert") and loading the tree saved to the file ("load_cold" after
+	the file is dropped from the page cache, "load_warm" when it is there).
+	*/
+	void measureLoad(int size, const string &path) {
+		vector<typename Tree::key_type> keys(size);
+		for (int i = 0; i < size; i++)
+			keys[i] = rnd();
+		int tree_size;
+		{
+			Tree tree;
+			long long allocs = getAllocCount();
+			auto start = std::chrono::steady_clock::now();
+
+			for (auto &key : keys)
+				tree.insert(key);
+
+			std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+			allocStats.push_back({"insert", {(double)(getAllocCount() - allocs)/size, time.count()/size}});
+			tree.save(path);
+			tree_size = tree.size();
+		}
+
+		for (string method : {"load_cold", "load_warm"}) {
+			if (method == "load_cold") {
+				int fd = open(path.c_str(), O_RDONLY);
+				if (fd < 0)
+					throw 1;
+				fdatasync(fd);
+				posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+				close(fd);
+			}
+			Tree tree;
+			long long allocs = getAllocCount();
+			auto start = std::chrono::steady_clock::now();
+
+			tree.load(path);
+
+			std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+			if (tree.size() != tree_size)
+				throw 1;
+			allocStats.push_back({method, {(double)(getAllocCount() - allocs)/size, time.count()/size}});
+		}
+	}
+
+	/*
+	The same as measure, but every operation is timed on its own and the latencies of each
+	block of "cicles" operations go to a histogram, whose percentiles are kept for the block.
+	*/
+	void measureLatency(int max_size, int cicles = 10000) {
+		Tree tree;
+		vector<typename Tree::key_type> random_elems(max_size + cicles);
+		for (auto &elem : random_elems)
+			elem = rnd();
+		LatencyHistogram histogram;
+
+		auto push = [this, &histogram](const string &operation, int size) {
+			vector<double> row = {(double)size};
+			for (double p : percentiles)
+				row.push_back(histogram.percentile(p));
+			latencyStats.push_back({operation, row});
+			histogram.clear();
+		};
+
+		int n = 0;
+		while (tree.size() < max_size && n < max_size) {
+			int start_size = tree.size();
+			for (int i = 0; i < cicles; i++) {
+				std::uint64_t start = getNanoTime();
+				tree.insert(random_elems[n++]);
+				histogram.record(getNanoTime() - start);
+			}
+			push("insertion", (start_size + tree.size())/2);
+		}
+
+		random_shuffle(random_elems.begin(), random_elems.end());
+
+		n = 0;
+		while (tree.size() > 0 && n < max_size) {
+			int start_size = tree.size();
+			for (int i = 0; i < cicles; i++) {
+				std::uint64_t start = getNanoTime();
+				doNotOptimize(tree.contains(random_elems[n++]));
+				histogram.record(getNanoTime() - start);
+			}
+			push("access", start_size);
+
+			n -= cicles;
+			for (int i = 0; i < cicles; i++) {
+				std::uint64_t start = getNanoTime();
+				tree.erase(random_elems[n++]);
+				histogram.record(getNanoTime() - start);
+			}
+			push("deletion", (start_size + tree.size())/2);
+		}
+	}
+
+	/*
+	Keys per second of loading the workload's keys by insertion ("load") and operations
+	per second of running its operations on them ("run").
+	*/
+	void measureWorkload(const WorkloadConfig &config) {
+		Workload<typename Tree::key_type> workload(config);
+		Tree tree;
+		double start = getCPUTime();
+
+		for (auto &key : workload.load_keys)
+			tree.insert(key);
+
+		double stop = getCPUTime();
+		if (start < 0 || stop < 0)
+			throw 1;
+		throughputStats.push_back({"load", workload.load_keys.size()/(stop - start)});
+
+		long long found = 0;
+		int scan_length = workload.scanLength();
+		start = getCPUTime();
+
+		for (auto &op : workload.operations)
+			found += apply(tree, op.first, op.second, scan_length);
+		doNotOptimize(found);
+
+		stop = getCPUTime();
+		if (start < 0 || stop < 0)
+			throw 1;
+		throughputStats.push_back({"run", workload.operations.size()/(stop - start)});
+	}
+
+	/*
+	Replays the trace (see "Trace.hpp") on an empty tree twice, streaming it from the mapped
+	file: at full speed for the operations per second ("replay", the decoding included),
+	and with every operation timed for the latency percentiles of each kind of them.
+	*/
+	void measureReplay(const string &path) {
+		Operation op;
+		const typename Tree::key_type *key;
+		int scan_length;
+		long long found = 0;
+		{
+			Tree tree;
+			TraceReader<typename Tree::key_type> trace(path);
+			std::uint64_t operations = trace.remaining();
+			double start = getCPUTime();
+
+			while (trace.next(op, key, scan_length))
+				found += apply(tree, op, *key, scan_length);
+			doNotOptimize(found);
+
+			double stop = getCPUTime();
+			if (start < 0 || stop < 0)
+				throw 1;
+			throughputStats.push_back({"replay", operations/(stop - start)});
+		}
+
+		static const char *names[] = {"lookup", "insert", "erase", "scan", "clear"};
+		LatencyHistogram histograms[std::size(names)];
+		Tree tree;
+		TraceReader<typename Tree::key_type> trace(path);
+		// The second pass must find the same keys as the first one
+		while (trace.next(op, key, scan_length)) {
+			std::uint64_t start = getNanoTime();
+			long long hits = apply(tree, op, *key, scan_length);
+			doNotOptimize(hits);
+			histograms[(int)op].record(getNanoTime() - start);
+			found -= hits;
+		}
+		if (found != 0)
+			throw 1;
+
+		for (std::size_t i = 0; i < std::size(names); i++)
+			if (histograms[i].count() > 0) {
+				vector<double> row = {(double)histograms[i].count()};
+				for (double p : percentiles)
+					row.push_back(histograms[i].percentile(p));
+				latencyStats.push_back({names[i], row});
+			}
+	}
+
+	void saveAllocStats(const string &filename) const {
+		fstream f(filename, f.out);
+		if (!f.is_open())
+			throw 1;
+		f << "method\tallocations\ttime\n";
+		for (auto &s : allocStats)
+			f << s.first << '\t' << s.second.first << '\t' << s.second.second << '\n';
+		f.close();
+	}
+
+	void saveThroughputStats(const string &filename) const {
+		fstream f(filename, f.out);
+		if (!f.is_open())
+			throw 1;
+		f << "method\tkeys_per_sec\n";
+		for (auto &s : throughputStats)
+			f << s.first << '\t' << s.second << '\n';
+		f.close();
+	}
+
+	void saveSnapshotStats(const string &filename) const {
+		fstream f(filename, f.out);
+		if (!f.is_open())
+			throw 1;
+		f << "snapshots\tbytes_per_key\n";
+		for (auto &s : snapshotStats)
+			f << s.first << '\t' << s.second << '\n';
+		f.close();
+	}
+
+	void saveLatencyStats(const string &filename) const {
+		fstream f(filename, f.out);
+		if (!f.is_open())
+			throw 1;
+		f << "operation\tsize\tp50\tp90\tp99\tp99.9\tmax\n";
+		for (auto &s : latencyStats) {
+			f << s.first;
+			for (double v : s.second)
+				f << '\t' << v;
+			f << '\n';
+		}
+		f.close();
+	}
+
+	void saveScanStats(const string &filename) const {
+		fstream f(filename, f.out);
+		if (!f.is_open())
+			throw 1;
+		f << "length\tkeys_per_sec\n";
+		for (auto &s : scanStats)
+			f << s.first << '\t' << s.second << '\n';
+		f.close();
+	}
+
 	void saveStats(const string &filename) const {
 		fstream f(filename, f.out);
-		f << "size_ins\tinsertion\tsize_acc\taccess\tsize_del\tdeletion\n";
 		if (!f.is_open())
 			throw 1;
+		f << "size_ins\tinsertion\tbytes_per_key\theap_bytes_per_key\tpeak_rss\tins_allocs_per_op";
+		writeCounterNames(f, "ins_");
+		f << "\tsize_acc\taccess\tacc_allocs_per_op";
+		writeCounterNames(f, "acc_");
+		f << "\tsize_del\tdeletion\tdel_allocs_per_op";
+		writeCounterNames(f, "del_");
+		f << '\n';
 		auto i = insertionStats.cbegin(), j = accessStats.cbegin(), k = deletionStats.cbegin();
+		auto m = memoryStats.cbegin();
+		auto h = heapStats.cbegin();
 		bool stop = false;
 		while (!stop)  {
 			stop = true;
-			if (i != insertionStats.cend())
-				f << i->first << '\t' << i->second, stop = false, i++;
-			if (j != accessStats.cend())
-				f << '\t' << j->first << '\t' << j->second, stop = false, j++;
-			if (k != deletionStats.cend())
-				f << '\t' << k->first << '\t' << k->second, stop = false, k++;
+			if (i != insertionStats.cend()) {
+				f << i->first << '\t' << i->second << '\t' << *m << '\t' << h->first << '\t' << h->second, stop = false;
+				f << '\t' << insertionAllocs[i - insertionStats.cbegin()];
+				writeCounters(f, insertionCounters, i - insertionStats.cbegin());
+				i++, m++, h++;
+			}
+			if (j != accessStats.cend()) {
+				f << '\t' << j->first << '\t' << j->second << '\t' << accessAllocs[j - accessStats.cbegin()], stop = false;
+				writeCounters(f, accessCounters, j - accessStats.cbegin());
+				j++;
+			}
+			if (k != deletionStats.cend()) {
+				f << '\t' << k->first << '\t' << k->second << '\t' << deletionAllocs[k - deletionStats.cbegin()], stop = false;
+				writeCounters(f, deletionCounters, k - deletionStats.cbegin());
+				k++;
+			}
 			f << '\n';
 		}
 		f.close();
@@ -5,201 +5,195 @@
 #include <utility>
 #include <iostream>
 #include <queue>
+#include <memory>
 
-#include "TreeBase.hpp"
+#include "SearchTree.hpp"
 #include "Node.hpp"
+#include "PoolAllocator.hpp"
+#include "TreeSet.hpp"
+#include "TreeMap.hpp"
+#include "JoinTree.hpp"
 
 using std::pair;
 
-template< class Key_t, class Compare_t = std::less<Key_t> >
-class RBtree : public TreeBase<Key_t, Compare_t> {
+/*
+Red-black balancing over any kind of elements. RBtree and RBmap below
+are the set and the map built on it.
+*/
+template< class Value_t, class Key_t, class KeyOf_t, class Compare_t, class Allocator_t, bool Counted, class Aggregate_t >
+class RBbase : public SearchTree<Node<Value_t, 1, Counted, Aggregate_t>, Key_t, KeyOf_t, Compare_t, Allocator_t> {
+protected:
+	// The color is kept in the spare bit of the parent pointer
+	typedef SearchTree<Node<Value_t, 1, Counted, Aggregate_t>, Key_t, KeyOf_t, Compare_t, Allocator_t> Base;
+	typedef typename Base::node_t node_t;
+	using Base::root;
+	using Base::comp;
+	using Base::alloc;
+	using Base::elems_num;
+	using Base::keyOf;
+	using Base::findNode;
+
 private:
 	enum color_t {red, black};
-	Node<pair<Key_t, color_t>> *root = nullptr;
-	Compare_t comp;
-	int elems_num = 0;
-
-	Node<pair<Key_t, color_t>> *find(const Key_t &key) const {
-		if (root == nullptr)
-			return nullptr;
-		Node<pair<Key_t, color_t>> *node = root;
-		while (1) {
-			if (comp(key, node->data.first)) {
-				if (node->getLeft() == nullptr)
-					return nullptr;
-				node = node->getLeft();
-			}
-			else if (comp(node->data.first, key)) {
-				if (node->getRight() == nullptr)
-					return nullptr;
-				node = node->getRight();
-			}
-			else
-				return node;
-		}
-	}
 
-	static color_t getColor(const Node<pair<Key_t, color_t>> *node) {
+	static color_t getColor(const node_t *node) {
 		if (node == nullptr)
 			return black;
-		return node->data.second;
+		return (color_t)node->getTag();
 	}
 
-	static void fixInsertion(Node<pair<Key_t, color_t>> *node) {
-		if (node->data.second == black)
-			return;
-
-		// Root
-		Node<pair<Key_t, color_t>> *father = node->getParent();
-		if (father == nullptr) {
-			node->data.second = black;
-			return;
-		}
-
-		if (father->data.second == black)
-			return;
+	static void setColor(node_t *node, color_t color) {
+		node->setTag(color);
+	}
 
-		Node<pair<Key_t, color_t>> *grandpa = father->getParent();
-		if (father->isLeft()) {
-			Node<pair<Key_t, color_t>> *uncle = grandpa->getRight();
-			auto uncle_color = (uncle == nullptr ? black : uncle->data.second);
-			if (uncle_color == red) {
-				father->data.second = black;
-				uncle->data.second = black;
-				grandpa->data.second = red;
-				fixInsertion(grandpa);
-				return;
-			}
+	static void swapColors(node_t *a, node_t *b) {
+		color_t color = getColor(a);
+		setColor(a, getColor(b));
+		setColor(b, color);
+	}
 
-			if (node->isRight()) {
-				father->rotateLeft();
-				grandpa->rotateRight();
-				node->data.second = black;
-				grandpa->data.second = red;
-				return;
+	/*
+	Restores the red node "node" whose father is red too.
+	"is_left" and "father_is_left" tell on which sides of their fathers they are.
+	*/
+	static void fixRedPair(node_t *node, bool is_left, node_t *father, bool father_is_left, node_t *grandpa,
+			node_t **tree_root) {
+		setColor(grandpa, red);
+		if (father_is_left) {
+			if (is_left) {
+				grandpa->rotateRight(tree_root);
+				setColor(father, black);
 			}
-
-			if (node->isLeft()) {
-				grandpa->rotateRight();
-				father->data.second = black;
-				grandpa->data.second = red;
+			else {
+				father->rotateLeft(tree_root);
+				grandpa->rotateRight(tree_root);
+				setColor(node, black);
 			}
 		}
-		else if (father->isRight()) {
-			Node<pair<Key_t, color_t>> *uncle = grandpa->getLeft();
-			auto uncle_color = (uncle == nullptr ? black : uncle->data.second);
-			if (uncle_color == red) {
-				father->data.second = black;
-				uncle->data.second = black;
-				grandpa->data.second = red;
-				fixInsertion(grandpa);
-				return;
-			}
-
-			if (node->isLeft()) {
-				father->rotateRight();
-				grandpa->rotateLeft();
-				node->data.second = black;
-				grandpa->data.second = red;
-				return;
+		else {
+			if (!is_left) {
+				grandpa->rotateLeft(tree_root);
+				setColor(father, black);
 			}
-
-			if (node->isRight()) {
-				grandpa->rotateLeft();
-				father->data.second = black;
-				grandpa->data.second = red;
+			else {
+				father->rotateRight(tree_root);
+				grandpa->rotateLeft(tree_root);
+				setColor(node, black);
 			}
 		}
-		else
-			throw 1;
 	}
 
-	// Fixes the situation that in the left there is less by one black nodes
-	static void fixLeftDeficite(Node<pair<Key_t, color_t>> *node) {
-		auto child = node->getLeft();
-		if (getColor(child) == red) {
-			child->data.second = black;
-			return;
-		}
-
-		auto sibling = node->getRight();
-		if (getColor(sibling) == red) {
-			std::swap(node->data.second, sibling->data.second);
-			node->rotateLeft();
-			fixLeftDeficite(node);
-			return;
-		}
-
-		// The sibling cannot be leaf beacuse there is left deficite of black nodes
-		if (getColor(sibling->getLeft()) == black && getColor(sibling->getRight()) == black) {
-			if (getColor(node) == black) {
-				sibling->data.second = red;
-				if (node->isLeft())
-					fixLeftDeficite(node->getParent());
-				else if (node->isRight())
-					fixRightDeficite(node->getParent());
-			}
-			else
-				std::swap(node->data.second, sibling->data.second);
-		}
-		else {
-			if (getColor(sibling->getRight()) == black) {
-				sibling->rotateRight();
-				std::swap(sibling->data.second, sibling->getParent()->data.second);
-				sibling = sibling->getParent();
+	// Restores the red node "node" whose father may be red too, climbing up while the uncles are red
+	static void fixRedUp(node_t *node, node_t **tree_root) {
+		while (1) {
+			node_t *father = node->getParent();
+			if (getColor(father) == black)
+				return;
+			// A red father is not the root, the root of the tree was black
+			node_t *grandpa = father->getParent();
+			bool is_left = (node == father->getLeft()), father_is_left = (father == grandpa->getLeft());
+			node_t *uncle = (father_is_left ? grandpa->getRight() : grandpa->getLeft());
+			if (getColor(uncle) == black) {
+				fixRedPair(node, is_left, father, father_is_left, grandpa, tree_root);
+				return;
 			}
-			node->rotateLeft();
-			std::swap(node->data.second, sibling->data.second);
-			sibling->getRight()->data.second = black;
+			setColor(father, black);
+			setColor(uncle, black);
+			setColor(grandpa, red);
+			node = grandpa;
 		}
 	}
 
-	// Fixes the situation that in the right there is less by one black nodes
-	static void fixRightDeficite(Node<pair<Key_t, color_t>> *node) {
-		auto child = node->getRight();
-		if (getColor(child) == red) {
-			child->data.second = black;
-			return;
-		}
+	/*
+	Fixes the situation that on the "is_left" side of the node there is less by one black nodes.
+	Climbs up while the deficite moves to the father.
+	*/
+	void fixDeficite(node_t *node, bool is_left) {
+		while (1) {
+			if (is_left) {
+				node_t *child = node->getLeft();
+				if (getColor(child) == red) {
+					setColor(child, black);
+					return;
+				}
 
-		auto sibling = node->getLeft();
-		if (getColor(sibling) == red) {
-			std::swap(node->data.second, sibling->data.second);
-			node->rotateRight();
-			fixRightDeficite(node);
-			return;
-		}
+				node_t *sibling = node->getRight();
+				if (getColor(sibling) == red) {
+					swapColors(node, sibling);
+					node->rotateLeft(&root);
+					sibling = node->getRight();
+				}
 
-		// The sibling cannot be leaf beacuse there is left deficite of black nodes
-		if (getColor(sibling->getRight()) == black && getColor(sibling->getLeft()) == black) {
-			if (getColor(node) == black) {
-				sibling->data.second = red;
-				if (node->isRight())
-					fixRightDeficite(node->getParent());
-				else if (node->isLeft())
-					fixLeftDeficite(node->getParent());
+				// The sibling cannot be leaf beacuse there is left deficite of black nodes
+				if (getColor(sibling->getLeft()) == black && getColor(sibling->getRight()) == black) {
+					setColor(sibling, red);
+					if (getColor(node) == red) {
+						setColor(node, black);
+						return;
+					}
+				}
+				else {
+					if (getColor(sibling->getRight()) == black) {
+						sibling->rotateRight(&root);
+						sibling = sibling->getParent();
+						swapColors(sibling, sibling->getRight());
+					}
+					node->rotateLeft(&root);
+					swapColors(node, sibling);
+					setColor(sibling->getRight(), black);
+					return;
+				}
 			}
-			else
-				std::swap(node->data.second, sibling->data.second);
-		}
-		else {
-			if (getColor(sibling->getLeft()) == black) {
-				sibling->rotateLeft();
-				std::swap(sibling->data.second, sibling->getParent()->data.second);
-				sibling = sibling->getParent();
+			else {
+				node_t *child = node->getRight();
+				if (getColor(child) == red) {
+					setColor(child, black);
+					return;
+				}
+
+				node_t *sibling = node->getLeft();
+				if (getColor(sibling) == red) {
+					swapColors(node, sibling);
+					node->rotateRight(&root);
+					sibling = node->getLeft();
+				}
+
+				// The sibling cannot be leaf beacuse there is right deficite of black nodes
+				if (getColor(sibling->getRight()) == black && getColor(sibling->getLeft()) == black) {
+					setColor(sibling, red);
+					if (getColor(node) == red) {
+						setColor(node, black);
+						return;
+					}
+				}
+				else {
+					if (getColor(sibling->getLeft()) == black) {
+						sibling->rotateLeft(&root);
+						sibling = sibling->getParent();
+						swapColors(sibling, sibling->getLeft());
+					}
+					node->rotateRight(&root);
+					swapColors(node, sibling);
+					setColor(sibling->getLeft(), black);
+					return;
+				}
 			}
-			node->rotateRight();
-			std::swap(node->data.second, sibling->data.second);
-			sibling->getLeft()->data.second = black;
+
+			// The whole subtree of the node lacks a black node now
+			node_t *father = node->getParent();
+			if (father == nullptr)
+				return;
+			is_left = (node == father->getLeft());
+			node = father;
 		}
 	}
 
-	static int check_rec(const Node<pair<Key_t, color_t>> *node) {
+	static int check_rec(const node_t *node) {
 		if (node == nullptr)
 			return 1;
 
-		Node<pair<Key_t, color_t>> *left = node->getLeft(), *right = node->getRight();
-		if (node->data.second == red)
+		node_t *left = node->getLeft(), *right = node->getRight();
+		if (getColor(node) == red)
 			if (getColor(left) == red || getColor(right) == red)
 				throw "Tree is incorrect!";
 
@@ -208,139 +202,201 @@ private:
 		if (left_black_num != right_black_num)
 			throw "Tree is incorrect!";
 
-		if (node->data.second == black)
+		if (getColor(node) == black)
 			return left_black_num + 1;
 		else
 			return left_black_num;
 	}
 
-public:
-	RBtree() {
-		comp = Compare_t();
-	}
-
-	RBtree(const Compare_t &comp) {
-		this->comp = comp;
-	}
-
-	~RBtree() {
-		if (root != nullptr)
-			root->remove();
-	}
-
-	void insert(const Key_t &key) {
+protected:
+	/*
+	Top-down insertion: a node with two red children is recolored on the way down,
+	so the new node never needs more than a local fix and nothing is walked back up.
+	*/
+	template< class Create_t >
+	std::pair<node_t*, bool> insertWith(const Key_t &key, Create_t create) {
 		if (root == nullptr) {
-			Node<pair<Key_t, color_t>>::createRoot({key, black}, &root);
+			root = create();
+			setColor(root, black);
 			elems_num++;
-			return;
+			return {root, true};
 		}
-		Node<pair<Key_t, color_t>> *node = root;
+
+		node_t *node = root, *father = nullptr, *grandpa = nullptr;
+		bool is_left = false, father_is_left = false;
 		while (1) {
-			if (comp(key, node->data.first)) {
-				if (node->getLeft() == nullptr) {
-					node->createLeft({key, red});
-					elems_num++;
-					fixInsertion(node->getLeft());
-					return;
-				}
-				node = node->getLeft();
+			bool created = false;
+			if (node == nullptr) {
+				node = create();
+				if (is_left)
+					father->setLeft(node);
+				else
+					father->setRight(node);
+				node->updateUp();
+				elems_num++;
+				created = true;
 			}
-			else if (comp(node->data.first, key)) {
-				if (node->getRight() == nullptr) {
-					node->createRight({key, red});
-					elems_num++;
-					fixInsertion(node->getRight());
-					return;
-				}
-				node = node->getRight();
+			else if (getColor(node->getLeft()) == red && getColor(node->getRight()) == red) {
+				// The root stays black
+				setColor(node, father == nullptr ? black : red);
+				setColor(node->getLeft(), black);
+				setColor(node->getRight(), black);
+			}
+
+			if (getColor(node) == red && getColor(father) == red) {
+				fixRedPair(node, is_left, father, father_is_left, grandpa, &root);
+				/*
+				The top of the fixed subtree is black now, so there cannot be
+				two red nodes in a row on the next step.
+				*/
 			}
+
+			if (created)
+				return {node, true};
+			bool go_left;
+			if (comp(key, keyOf(node)))
+				go_left = true;
+			else if (comp(keyOf(node), key))
+				go_left = false;
 			else
-				return; // This key already exists
+				return {node, false}; // This key already exists
+
+			grandpa = father;
+			father = node;
+			father_is_left = is_left;
+			is_left = go_left;
+			node = (go_left ? node->getLeft() : node->getRight());
 		}
 	}
 
-	bool contains(const Key_t &key) const {
-		return !(find(key) == nullptr);
+	static void setBuiltTag(node_t *node, int, int, bool deepest) {
+		setColor(node, deepest ? red : black);
 	}
 
-	void erase(const Key_t &key) {
-		Node<pair<Key_t, color_t>> *node = find(key);
+	// The rank used by joins is the black height, the root of a joined tree is always black
+	static int rankOf(const node_t *tree) {
+		int rank = 0;
+		for (; tree != nullptr; tree = tree->getLeft())
+			rank += (getColor(tree) == black);
+		return rank;
+	}
+
+	// Takes a subtree of the root "node" of a tree with the given rank off, returns it with its rank
+	static node_t *cutChild(node_t *node, int rank, bool left, int &child_rank) {
+		node_t *child = (left ? node->cutLeft() : node->cutRight());
+		child_rank = rank - (getColor(node) == black);
+		if (getColor(child) == red) {
+			setColor(child, black);
+			child_rank++;
+		}
+		return child;
+	}
+
+	/*
+	Joins the trees "left" and "right" with the single node "middle" between them.
+	Goes down the side of the higher tree to a black node of the black height of the other one,
+	links the node there as red and fixes red pairs up, so it takes O(|left_rank - right_rank| + 1).
+	*/
+	static node_t *joinNodes(node_t *left, int left_rank, node_t *middle, node_t *right, int right_rank, int &rank) {
+		node_t *tree;
+		if (left_rank > right_rank) {
+			node_t *p = nullptr, *c = tree = left;
+			for (int bc = left_rank; getColor(c) == red || bc > right_rank; c = c->getRight()) {
+				bc -= (getColor(c) == black);
+				p = c;
+			}
+			middle->setLeft(c);
+			middle->setRight(right);
+			p->setRight(middle);
+		}
+		else if (right_rank > left_rank) {
+			node_t *p = nullptr, *c = tree = right;
+			for (int bc = right_rank; getColor(c) == red || bc > left_rank; c = c->getLeft()) {
+				bc -= (getColor(c) == black);
+				p = c;
+			}
+			middle->setLeft(left);
+			middle->setRight(c);
+			p->setLeft(middle);
+		}
+		else {
+			middle->setLeft(left);
+			middle->setRight(right);
+			setColor(middle, black);
+			middle->update();
+			rank = left_rank + 1;
+			return middle;
+		}
+		setColor(middle, red);
+		middle->updateUp();
+		fixRedUp(middle, &tree);
+		rank = (left_rank > right_rank ? left_rank : right_rank);
+		if (getColor(tree) == red) {
+			setColor(tree, black);
+			rank++;
+		}
+		return tree;
+	}
+
+	void eraseNode(node_t *node) {
 		if (node == nullptr)
 			return;
 
-		elems_num--;
-		Node<pair<Key_t, color_t>> *n = node;
-		if (n->getLeft() != nullptr && n->getRight() != nullptr) {
-			n = n->getRight();
-			while (n->getLeft() != nullptr)
-				n = n->getLeft();
-			std::swap(node->data.first, n->data.first);
-			node = n;
-		}
+		auto r = this->unlinkNode(node);
+		node_t::destroy(node, alloc);
 
 		/*
-		It isn't posssible it to have
-		a black child, because the number of black nodes in
-		any path must be equal.
+		A red node with at most one child has no children at all,
+		because the number of black nodes in any path must be equal.
 		*/
-
-		if (node->data.second == red) {
-			node->remove();
+		if (r.tag == red)
 			return;
-		}
 
-		Node<pair<Key_t, color_t>> *father = node->getParent();
+		if (r.child != nullptr)
+			setColor(r.child, black);
+		else if (r.parent != nullptr)
+			fixDeficite(r.parent, r.from_left);
+	}
 
-		Node<pair<Key_t, color_t>> *child = (node->getLeft() == nullptr ? node->getRight() : node->getLeft());
-		// Replace the node by its child
-		if (child != nullptr) {
-			if (node->isLeft()) {
-				child->bindToLeft(*father);
-				fixLeftDeficite(father);
-			}
-			else if (node->isRight()) {
-				child->bindToRight(*father);
-				fixRightDeficite(father);
-			}
-			else {
-				child->bindToRoot();
-				child->data.second = black;
-			}
-		}
-		else {
-			if (node->isLeft()) {
-				node->remove();
-				fixLeftDeficite(father);
-			}
-			else if (node->isRight()) {
-				node->remove();
-				fixRightDeficite(father);
-			}
-			else
-				node->remove();
-		}
+public:
+	RBbase(const Compare_t &comp, const Allocator_t &alloc) : Base(comp, alloc) {}
+
+	void erase(const Key_t &key) {
+		eraseNode(findNode(key));
 	}
 
-	int size() const {
-		return elems_num;
+	template< class K, class C = Compare_t, class = typename C::is_transparent >
+	void erase(const K &key) {
+		eraseNode(findNode(key));
+	}
+
+	/*
+	Replaces the contents by the elements of [first, last), in O(n) if they are sorted.
+	All the leaves of the built tree are on the two last levels, so it is enough
+	to paint the deepest level red.
+	*/
+	template< class Iterator_t >
+	void build(Iterator_t first, Iterator_t last) {
+		this->buildFrom(first, last, setBuiltTag);
 	}
 
 	void print() const {
 		if (root == nullptr)
 			return;
-		std::queue<Node<pair<Key_t, color_t>>*> q;
+		std::queue<node_t*> q;
 
-		int width = (1 << root->getHeight()) - 1;
+		int h = node_t::height(root);
+		int width = (1 << h) - 1;
 		q.push(root);
 		int pos_num = 1;
-		for (int j = 0; j < root->getHeight(); j++, pos_num = 2 * pos_num, width=width/2) {
+		for (int j = 0; j < h; j++, pos_num = 2 * pos_num, width=width/2) {
 			for (int k = 0; k < width/2; k++)
 				std::cout << ' ';
 			for (int i = 0; i < pos_num; i++) {
 				if (i > 0)
 					for (int k = 0; k < width; k++)
 						std::cout << ' ';
-				Node<pair<Key_t, color_t>> *node = q.front();
+				node_t *node = q.front();
 				q.pop();
 				if (node == nullptr) {
 					std::cout << ' ';
@@ -348,10 +404,10 @@ public:
 					q.push(nullptr);
 				}
 				else {
-					if (node->data.second == red)
-						std::cout << "\x1b[31m" <<  node->data.first << "\x1b[0m";
+					if (getColor(node) == red)
+						std::cout << "\x1b[31m" <<  keyOf(node) << "\x1b[0m";
 					else
-						std::cout << node->data.first;
+						std::cout << keyOf(node);
 					q.push(node->getLeft());
 					q.push(node->getRight());
 				}
@@ -365,10 +421,30 @@ public:
 	void check() const {
 		if (root == nullptr)
 			return;
-		if (root->data.second == red)
+		if (getColor(root) == red)
 			throw "Tree is incorrect!";
 		check_rec(root);
+		this->checkCounts(root);
 	}
 };
 
+template< class Key_t, class Compare_t = std::less<Key_t>, class Allocator_t = PoolAllocator<Key_t>, bool Counted = false,
+	class Aggregate_t = void >
+class RBtree : public TreeSet<JoinTree<RBbase<Key_t, Key_t, Identity<Key_t>, Compare_t, Allocator_t, Counted, Aggregate_t>>> {
+public:
+	RBtree(const Compare_t &comp = Compare_t(), const Allocator_t &alloc = Allocator_t())
+		: TreeSet<JoinTree<RBbase<Key_t, Key_t, Identity<Key_t>, Compare_t, Allocator_t, Counted, Aggregate_t>>>(comp, alloc) {}
+};
+
+template< class Key_t, class Mapped_t, class Compare_t = std::less<Key_t>,
+	class Allocator_t = PoolAllocator<std::pair<const Key_t, Mapped_t>>, bool Counted = false,
+	class Aggregate_t = void >
+class RBmap : public TreeMap<JoinTree<RBbase<std::pair<const Key_t, Mapped_t>, Key_t,
+	SelectFirst<std::pair<const Key_t, Mapped_t>>, Compare_t, Allocator_t, Counted, Aggregate_t>>> {
+public:
+	RBmap(const Compare_t &comp = Compare_t(), const Allocator_t &alloc = Allocator_t())
+		: TreeMap<JoinTree<RBbase<std::pair<const Key_t, Mapped_t>, Key_t,
+			SelectFirst<std::pair<const Key_t, Mapped_t>>, Compare_t, Allocator_t, Counted, Aggregate_t>>>(comp, alloc) {}
+};
+
 #endif /* RBTREE_HPP */
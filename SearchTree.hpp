@@ -0,0 +1,462 @@
+#ifndef SEARCHTREE_HPP
+#define SEARCHTREE_HPP
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "TreeBase.hpp"
+#include "TreeIterator.hpp"
+#include "FrozenSet.hpp"
+
+// Key extraction for sets: the element is the key
+template< class Key_t >
+struct Identity {
+	typedef const Key_t element_type;
+
+	const Key_t &operator()(const Key_t &key) const {
+		return key;
+	}
+};
+
+// Key extraction for maps: the element is a pair of the key and the mapped value
+template< class Pair_t >
+struct SelectFirst {
+	typedef Pair_t element_type;
+
+	const typename Pair_t::first_type &operator()(const Pair_t &pair) const {
+		return pair.first;
+	}
+};
+
+/*
+The part of a binary search tree which does not depend on balancing:
+the root, lookups, ordered traversal and freeing of the nodes.
+KeyOf_t takes the key out of an element stored in a node.
+*/
+template< class Node_t, class Key_t, class KeyOf_t, class Compare_t, class Allocator_t >
+class SearchTree : public TreeBase<Key_t, Compare_t> {
+protected:
+	typedef Node_t node_t;
+	typedef typename std::allocator_traits<Allocator_t>::template rebind_alloc<node_t> node_allocator;
+
+	node_t *root = nullptr;
+	Compare_t comp;
+	node_allocator alloc;
+	int elems_num = 0;
+
+	// How many keys go down the tree together in the batched operations
+	static constexpr std::size_t batch_group = 16;
+
+	SearchTree(const Compare_t &comp, const Allocator_t &alloc) : comp(comp), alloc(alloc) {}
+
+	static const Key_t &keyOf(const node_t *node) {
+		return KeyOf_t()(node->data);
+	}
+
+	static const Key_t &keyOf(const typename node_t::data_type &elem) {
+		return KeyOf_t()(elem);
+	}
+
+	~SearchTree() {
+		clear();
+	}
+
+	template< class K >
+	node_t *findNode(const K &key) const {
+		node_t *node = root;
+		while (node != nullptr) {
+			if (comp(key, keyOf(node)))
+				node = node->getLeft();
+			else if (comp(keyOf(node), key))
+				node = node->getRight();
+			else
+				return node;
+		}
+		return nullptr;
+	}
+
+	// The first node not less than the key
+	template< class K >
+	node_t *lowerBoundNode(const K &key) const {
+		node_t *node = root, *res = nullptr;
+		while (node != nullptr) {
+			if (comp(keyOf(node), key))
+				node = node->getRight();
+			else {
+				res = node;
+				node = node->getLeft();
+			}
+		}
+		return res;
+	}
+
+	// The first node greater than the key
+	template< class K >
+	node_t *upperBoundNode(const K &key) const {
+		node_t *node = root, *res = nullptr;
+		while (node != nullptr) {
+			if (comp(key, keyOf(node))) {
+				res = node;
+				node = node->getLeft();
+			}
+			else
+				node = node->getRight();
+		}
+		return res;
+	}
+
+	// What has changed after a node was taken out of the tree
+	struct Removal {
+		node_t *parent; // The node which lost a descendant where the tree got shorter
+		bool from_left; // On which side of the parent
+		node_t *child; // The node which took that place, maybe null
+		unsigned tag; // The tag of the node which was at that place before
+	};
+
+	/*
+	Takes the node out of the tree without destroying it. A node with two children
+	is replaced by its successor, which is relinked rather than copied.
+	*/
+	Removal unlinkNode(node_t *node) {
+		Removal r;
+		if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+			node_t *next = node_t::leftmost(node->getRight());
+			r.parent = next->getParent();
+			r.from_left = (r.parent != node);
+			r.child = next->getRight();
+			r.tag = next->getTag();
+			next->replaceBy(r.child, &root);
+			node->substituteBy(next, &root);
+			if (r.parent == node)
+				r.parent = next;
+		}
+		else {
+			r.parent = node->getParent();
+			r.from_left = node->isLeft();
+			r.child = (node->getLeft() != nullptr ? node->getLeft() : node->getRight());
+			r.tag = node->getTag();
+			node->replaceBy(r.child, &root);
+		}
+		if (r.parent != nullptr)
+			r.parent->updateUp();
+		elems_num--;
+		return r;
+	}
+
+	// Returns the size of the subtree, throws if a counting node has a wrong one
+	static int checkCounts(const node_t *node) {
+		if (node == nullptr)
+			return 0;
+		int n = checkCounts(node->getLeft()) + checkCounts(node->getRight()) + 1;
+		if constexpr (node_t::counted)
+			if (n != node_t::subtreeSize(node))
+				throw "Tree is incorrect!";
+		return n;
+	}
+
+	/*
+	Builds a perfectly balanced subtree of the n elements given by next(), which come sorted and unique.
+	The nodes are created in order, so they lie in memory in order as well.
+	setTag(node, left height, right height, is on the deepest level but not the root) sets the tree-specific tag.
+	*/
+	template< class Next_t, class SetTag_t >
+	node_t *buildSubtree(Next_t &next, std::size_t n, int depth, int levels, int &height, SetTag_t &setTag) {
+		if (n == 0) {
+			height = 0;
+			return nullptr;
+		}
+		int lh, rh;
+		node_t *left = buildSubtree(next, (n - 1) / 2, depth + 1, levels, lh, setTag);
+		node_t *node = node_t::create(alloc, next());
+		node_t *right = buildSubtree(next, n / 2, depth + 1, levels, rh, setTag);
+		node->setLeft(left);
+		node->setRight(right);
+		node->update();
+		setTag(node, lh, rh, depth > 0 && depth == levels - 1);
+		height = (lh > rh ? lh : rh) + 1;
+		return node;
+	}
+
+	// Returns the root of a new tree, which is not linked anywhere
+	template< class Next_t, class SetTag_t >
+	node_t *buildSorted(Next_t next, std::size_t n, SetTag_t &setTag) {
+		int levels = 0;
+		for (std::size_t m = n; m > 0; m >>= 1)
+			levels++;
+		int height;
+		return buildSubtree(next, n, 0, levels, height, setTag);
+	}
+
+	/*
+	Replaces the contents by the elements of [first, last) in O(n) if they are sorted.
+	Otherwise they are copied, sorted and deduplicated first.
+	*/
+	template< class Iterator_t, class SetTag_t >
+	void buildFrom(Iterator_t first, Iterator_t last, SetTag_t setTag) {
+		auto less = [this](const value_type *a, const value_type *b) {
+			return comp(KeyOf_t()(*a), KeyOf_t()(*b));
+		};
+		auto not_less = [&less](const value_type *a, const value_type *b) {
+			return !less(a, b);
+		};
+		clear();
+
+		typedef typename std::iterator_traits<Iterator_t>::iterator_category category;
+		typedef typename std::iterator_traits<Iterator_t>::value_type input_type;
+		// Elements of another type (as pairs with a non-const key for maps) are converted first
+		if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value &&
+				std::is_same<std::remove_cv_t<input_type>, std::remove_cv_t<value_type>>::value) {
+			bool sorted = true;
+			if (first != last)
+				for (Iterator_t prev = first, it = std::next(first); it != last && sorted; prev = it++)
+					sorted = less(&*prev, &*it);
+			if (sorted) {
+				std::size_t n = std::distance(first, last);
+				root = buildSorted([&first]() -> decltype(auto) {
+					return *first++;
+				}, n, setTag);
+				elems_num = n;
+				return;
+			}
+		}
+
+		// The elements may be not assignable (as the pairs of maps), so their addresses are sorted
+		std::vector<value_type> elems(first, last);
+		std::vector<value_type*> order(elems.size());
+		for (std::size_t i = 0; i < elems.size(); i++)
+			order[i] = &elems[i];
+		auto end = order.end();
+		if (std::adjacent_find(order.begin(), order.end(), not_less) != order.end()) {
+			std::stable_sort(order.begin(), order.end(), less);
+			end = std::unique(order.begin(), order.end(), not_less);
+		}
+		auto it = order.begin();
+		root = buildSorted([&it]() -> value_type&& {
+			return std::move(**it++);
+		}, end - order.begin(), setTag);
+		elems_num = end - order.begin();
+	}
+
+public:
+	typedef typename node_t::data_type value_type;
+	// The mapped values are const when the aggregates of the subtrees are taken of them
+	typedef TreeIterator<node_t, std::conditional_t<node_t::aggregated,
+		const typename KeyOf_t::element_type, typename KeyOf_t::element_type>> iterator;
+	typedef iterator const_iterator;
+
+	iterator begin() const {
+		return iterator(root == nullptr ? nullptr : node_t::leftmost(root), &root);
+	}
+
+	iterator end() const {
+		return iterator(nullptr, &root);
+	}
+
+	iterator find(const Key_t &key) const {
+		return iterator(findNode(key), &root);
+	}
+
+	iterator lower_bound(const Key_t &key) const {
+		return iterator(lowerBoundNode(key), &root);
+	}
+
+	iterator upper_bound(const Key_t &key) const {
+		return iterator(upperBoundNode(key), &root);
+	}
+
+	std::pair<iterator, iterator> equal_range(const Key_t &key) const {
+		node_t *node = findNode(key);
+		if (node == nullptr) {
+			iterator it = lower_bound(key);
+			return {it, it};
+		}
+		return {iterator(node, &root), iterator(node->next(), &root)};
+	}
+
+	/*
+	With a transparent comparator (one that has is_transparent, like std::less<>)
+	the lookups take anything comparable with the keys, without building a key.
+	*/
+	template< class K, class C = Compare_t, class = typename C::is_transparent >
+	iterator find(const K &key) const {
+		return iterator(findNode(key), &root);
+	}
+
+	template< class K, class C = Compare_t, class = typename C::is_transparent >
+	iterator lower_bound(const K &key) const {
+		return iterator(lowerBoundNode(key), &root);
+	}
+
+	template< class K, class C = Compare_t, class = typename C::is_transparent >
+	iterator upper_bound(const K &key) const {
+		return iterator(upperBoundNode(key), &root);
+	}
+
+	template< class K, class C = Compare_t, class = typename C::is_transparent >
+	std::pair<iterator, iterator> equal_range(const K &key) const {
+		return {lower_bound(key), upper_bound(key)};
+	}
+
+	template< class K, class C = Compare_t, class = typename C::is_transparent >
+	bool contains(const K &key) const {
+		return !(findNode(key) == nullptr);
+	}
+
+	/*
+	Immutable copy of the keys for lookups only, built in O(n). The tree stays the one to
+	be changed, and the readers switch to a new snapshot when it is frozen again.
+	*/
+	FrozenSet<Key_t, Compare_t> freeze() const {
+		node_t *node = (root == nullptr ? nullptr : node_t::leftmost(root));
+		return FrozenSet<Key_t, Compare_t>::fromSorted(elems_num, [&node]() -> const Key_t& {
+			const Key_t &key = keyOf(node);
+			node = node->next();
+			return key;
+		}, comp);
+	}
+
+	/*
+	Looks up n keys and writes to out whether each of them is present.
+	The keys go down the tree in groups, one level for every key of a group in turn,
+	and the next node of every key is prefetched, so the cache misses overlap.
+	*/
+	void contains_batch(const Key_t *keys, std::size_t n, bool *out) const {
+		node_t *cur[batch_group];
+		for (std::size_t base = 0; base < n; base += batch_group) {
+			std::size_t m = (n - base < batch_group ? n - base : batch_group);
+			for (std::size_t i = 0; i < m; i++) {
+				cur[i] = root;
+				out[base + i] = false;
+			}
+			bool active = (root != nullptr);
+			while (active) {
+				active = false;
+				for (std::size_t i = 0; i < m; i++) {
+					node_t *node = cur[i];
+					if (node == nullptr)
+						continue;
+					const Key_t &key = keys[base + i];
+					if (comp(key, keyOf(node)))
+						node = node->getLeft();
+					else if (comp(keyOf(node), key))
+						node = node->getRight();
+					else {
+						out[base + i] = true;
+						node = nullptr;
+					}
+					if (node != nullptr) {
+						__builtin_prefetch(node);
+						active = true;
+					}
+					cur[i] = node;
+				}
+			}
+		}
+	}
+
+	// The aggregate of the elements with the keys in [lo, hi) in O(log n), for the trees with an aggregate policy
+	auto aggregate(const Key_t &lo, const Key_t &hi) const {
+		typedef typename node_t::aggregate_type A;
+		// The top node of the range, the parts of the range on its left and right are collected separately
+		node_t *top = root;
+		while (top != nullptr && (comp(keyOf(top), lo) || !comp(keyOf(top), hi)))
+			top = (comp(keyOf(top), lo) ? top->getRight() : top->getLeft());
+		if (top == nullptr)
+			return A::identity();
+
+		auto left = A::identity(), right = A::identity();
+		for (node_t *node = top->getLeft(); node != nullptr; ) {
+			if (comp(keyOf(node), lo))
+				node = node->getRight();
+			else {
+				left = A::combine(A::combine(A::of(node->data), node_t::aggregateOf(node->getRight())), left);
+				node = node->getLeft();
+			}
+		}
+		for (node_t *node = top->getRight(); node != nullptr; ) {
+			if (comp(keyOf(node), hi)) {
+				right = A::combine(right, A::combine(node_t::aggregateOf(node->getLeft()), A::of(node->data)));
+				node = node->getRight();
+			}
+			else
+				node = node->getLeft();
+		}
+		return A::combine(A::combine(left, A::of(top->data)), right);
+	}
+
+	// Calls f for every element with the key in [lo, hi) in order
+	template< class Function_t >
+	void for_each(const Key_t &lo, const Key_t &hi, Function_t f) const {
+		for (node_t *node = lowerBoundNode(lo); node != nullptr && comp(keyOf(node), hi); node = node->next())
+			f(node->data);
+	}
+
+	bool contains(const Key_t &key) const {
+		return !(findNode(key) == nullptr);
+	}
+
+	/*
+	The order statistics below take O(log n) and work only for the trees
+	which count their subtrees. rank() is the number of the keys less than the key.
+	*/
+	int rank(const Key_t &key) const {
+		int res = 0;
+		for (node_t *node = root; node != nullptr; ) {
+			if (comp(keyOf(node), key)) {
+				res += node_t::subtreeSize(node->getLeft()) + 1;
+				node = node->getRight();
+			}
+			else
+				node = node->getLeft();
+		}
+		return res;
+	}
+
+	// The element with k keys less than its own, or end()
+	iterator select(int k) const {
+		node_t *node = root;
+		while (node != nullptr) {
+			int left_size = node_t::subtreeSize(node->getLeft());
+			if (k < left_size)
+				node = node->getLeft();
+			else if (k > left_size) {
+				k -= left_size + 1;
+				node = node->getRight();
+			}
+			else
+				break;
+		}
+		return iterator(node, &root);
+	}
+
+	// The number of the keys in [lo, hi)
+	int count_range(const Key_t &lo, const Key_t &hi) const {
+		if (!comp(lo, hi))
+			return 0;
+		return rank(hi) - rank(lo);
+	}
+
+	int size() const {
+		return elems_num;
+	}
+
+	// Removes all the elements in O(n), or in O(1) if the nodes come from a pool
+	void clear() {
+		node_t::destroyAll(root, alloc);
+		root = nullptr;
+		elems_num = 0;
+	}
+
+	// Bytes taken by the tree and its nodes, not counting the allocator's own overhead
+	std::size_t memoryUsage() const {
+		return sizeof(*this) + elems_num * sizeof(node_t);
+	}
+};
+
+#endif /* SEARCHTREE_HPP */
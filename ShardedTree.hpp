@@ -0,0 +1,279 @@
+#ifndef SHARDEDTREE_HPP
+#define SHARDEDTREE_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+
+#include "TreeBase.hpp"
+
+/*
+A set split by the key ranges into shards, each of them a tree with its own lock, so
+the changes of different ranges go on in parallel. The layout (the shards and their
+bounds) is shared by all the operations and taken whole only to rebalance.
+It starts with one shard, which is split in halves while there are less shards than
+asked for. Then a shard which grows half as large again as the average makes all the
+keys be spread evenly over the shards, which takes O(n), so it is done again only after
+as many new keys as half of the set, and the inserts stay O(log n) amortized even if
+the keys grow, as the timestamps. Tree_t must be a JoinTree.
+*/
+template< class Tree_t >
+class ShardedTree : public TreeBase<typename Tree_t::key_type, typename Tree_t::key_compare> {
+public:
+	typedef typename Tree_t::key_type key_type;
+	typedef typename Tree_t::key_compare key_compare;
+
+private:
+	// Smaller shards are not split
+	static constexpr int min_shard = 1 << 10;
+
+	struct Shard {
+		Tree_t tree;
+		mutable std::mutex m;
+	};
+
+	std::vector<std::unique_ptr<Shard>> shards;
+	std::vector<key_type> bounds; // The shard i has the keys from bounds[i - 1] to below bounds[i]
+	mutable std::shared_mutex layout;
+	std::atomic<int> elems_num{0};
+	std::atomic<int> inserted{0}; // The new keys since the keys were spread
+	unsigned max_shards;
+	key_compare comp;
+
+	std::size_t shardOf(const key_type &key) const {
+		return std::upper_bound(bounds.begin(), bounds.end(), key, comp) - bounds.begin();
+	}
+
+	bool skewed(int shard_size) const {
+		return shard_size > min_shard && 2LL * shard_size * max_shards > 3LL * elems_num;
+	}
+
+	// Spreading the keys is not repeated until enough of them are inserted
+	bool spreadDue() const {
+		return 2LL * inserted >= elems_num;
+	}
+
+	// The middle key of a tree with at least 2 keys
+	static key_type middle(const Tree_t &tree) {
+		return *std::next(tree.begin(), tree.size()/2);
+	}
+
+	void rebalance(const key_type &key) {
+		std::unique_lock<std::shared_mutex> lock(layout);
+		std::size_t i = shardOf(key);
+		if (!skewed(shards[i]->tree.size()))
+			return;
+		if (shards.size() < max_shards) {
+			key_type mid = middle(shards[i]->tree);
+			std::unique_ptr<Shard> right(new Shard);
+			shards[i]->tree.split(mid, right->tree);
+			shards.insert(shards.begin() + i + 1, std::move(right));
+			bounds.insert(bounds.begin() + i, std::move(mid));
+			return;
+		}
+		if (shards.size() == 1 || !spreadDue())
+			return;
+		// The keys of all the shards in order, cut into equal parts
+		std::vector<key_type> keys;
+		keys.reserve(elems_num);
+		for (auto &shard : shards)
+			keys.insert(keys.end(), shard->tree.begin(), shard->tree.end());
+		std::size_t n = keys.size(), k = shards.size();
+		if (n < k)
+			return;
+		for (std::size_t j = 0; j < k; j++) {
+			shards[j]->tree.build(keys.begin() + j * n / k, keys.begin() + (j + 1) * n / k);
+			if (j > 0)
+				bounds[j - 1] = keys[j * n / k];
+		}
+		inserted = 0;
+	}
+
+public:
+	// Iterates over all the keys in order. It is not safe while the tree is changed.
+	class const_iterator {
+	private:
+		typedef typename Tree_t::iterator tree_iterator;
+
+		const ShardedTree *owner = nullptr;
+		std::size_t shard = 0;
+		tree_iterator it;
+
+		void skipEmpty() {
+			while (shard < owner->shards.size() && it == owner->shards[shard]->tree.end()) {
+				shard++;
+				if (shard < owner->shards.size())
+					it = owner->shards[shard]->tree.begin();
+			}
+		}
+
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef key_type value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const key_type *pointer;
+		typedef const key_type &reference;
+
+		const_iterator() = default;
+
+		const_iterator(const ShardedTree *owner, std::size_t shard) : owner(owner), shard(shard) {
+			if (shard < owner->shards.size()) {
+				it = owner->shards[shard]->tree.begin();
+				skipEmpty();
+			}
+		}
+
+		reference operator*() const {
+			return *it;
+		}
+
+		pointer operator->() const {
+			return &*it;
+		}
+
+		const_iterator &operator++() {
+			++it;
+			skipEmpty();
+			return *this;
+		}
+
+		const_iterator operator++(int) {
+			const_iterator res = *this;
+			++*this;
+			return res;
+		}
+
+		bool operator==(const const_iterator &other) const {
+			if (shard != other.shard)
+				return false;
+			return shard == owner->shards.size() || it == other.it;
+		}
+
+		bool operator!=(const const_iterator &other) const {
+			return !(*this == other);
+		}
+	};
+
+	typedef const_iterator iterator;
+
+	explicit ShardedTree(unsigned max_shards = 4 * std::thread::hardware_concurrency(), const key_compare &comp = key_compare())
+			: max_shards(max_shards == 0 ? 1 : max_shards), comp(comp) {
+		shards.emplace_back(new Shard);
+	}
+
+	ShardedTree(const ShardedTree &) = delete;
+	ShardedTree &operator=(const ShardedTree &) = delete;
+
+	void insert(const key_type &key) {
+		int shard_size;
+		{
+			std::shared_lock<std::shared_mutex> lock(layout);
+			Shard &s = *shards[shardOf(key)];
+			std::lock_guard<std::mutex> shard_lock(s.m);
+			int n = s.tree.size();
+			s.tree.insert(key);
+			shard_size = s.tree.size();
+			if (shard_size != n) {
+				elems_num++;
+				inserted++;
+			}
+		}
+		if (skewed(shard_size) && (shardCount() < (int)max_shards || spreadDue()))
+			rebalance(key);
+	}
+
+	void erase(const key_type &key) {
+		std::shared_lock<std::shared_mutex> lock(layout);
+		Shard &s = *shards[shardOf(key)];
+		std::lock_guard<std::mutex> shard_lock(s.m);
+		int n = s.tree.size();
+		s.tree.erase(key);
+		elems_num -= n - s.tree.size();
+	}
+
+	bool contains(const key_type &key) const {
+		std::shared_lock<std::shared_mutex> lock(layout);
+		const Shard &s = *shards[shardOf(key)];
+		std::lock_guard<std::mutex> shard_lock(s.m);
+		return s.tree.contains(key);
+	}
+
+	int size() const {
+		return elems_num;
+	}
+
+	void clear() {
+		std::unique_lock<std::shared_mutex> lock(layout);
+		shards.resize(1);
+		shards[0]->tree.clear();
+		bounds.clear();
+		elems_num = 0;
+		inserted = 0;
+	}
+
+	// Calls f for the keys from lo to below hi in order, locking one shard at a time
+	template< class Function_t >
+	void for_each(const key_type &lo, const key_type &hi, Function_t f) const {
+		std::shared_lock<std::shared_mutex> lock(layout);
+		for (std::size_t i = shardOf(lo); i < shards.size() && (i == 0 || comp(bounds[i - 1], hi)); i++) {
+			std::lock_guard<std::mutex> shard_lock(shards[i]->m);
+			shards[i]->tree.for_each(lo, hi, f);
+		}
+	}
+
+	const_iterator begin() const {
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const {
+		return const_iterator(this, shards.size());
+	}
+
+	int shardCount() const {
+		std::shared_lock<std::shared_mutex> lock(layout);
+		return shards.size();
+	}
+
+	void print() const {
+		std::shared_lock<std::shared_mutex> lock(layout);
+		for (auto &s : shards) {
+			std::lock_guard<std::mutex> shard_lock(s->m);
+			s->tree.print();
+		}
+	}
+
+	void check() const {
+		std::shared_lock<std::shared_mutex> lock(layout);
+		int n = 0;
+		for (std::size_t i = 0; i < shards.size(); i++) {
+			std::lock_guard<std::mutex> shard_lock(shards[i]->m);
+			const Tree_t &tree = shards[i]->tree;
+			tree.check();
+			n += tree.size();
+			if (tree.size() == 0)
+				continue;
+			if (i > 0 && comp(*tree.begin(), bounds[i - 1]))
+				throw "Tree is incorrect!";
+			if (i + 1 < shards.size() && !comp(*std::prev(tree.end()), bounds[i]))
+				throw "Tree is incorrect!";
+		}
+		if (n != elems_num)
+			throw "Tree is incorrect!";
+	}
+
+	std::size_t memoryUsage() const {
+		std::shared_lock<std::shared_mutex> lock(layout);
+		std::size_t res = sizeof(*this) + bounds.capacity() * sizeof(key_type);
+		for (auto &s : shards)
+			res += sizeof(Shard) - sizeof(Tree_t) + s->tree.memoryUsage();
+		return res;
+	}
+};
+
+#endif /* SHARDEDTREE_HPP */
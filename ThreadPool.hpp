@@ -0,0 +1,125 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+
+/*
+Fixed set of worker threads for fork-join work. A forked task is run by whoever
+comes first: a worker, or the thread which joins it. So a thread never waits for
+a task nobody has started, and nested forks cannot lock the pool up.
+*/
+class ThreadPool {
+private:
+	struct Task {
+		std::function<void()> run;
+		std::atomic<bool> taken{false};
+		bool done = false;
+		std::mutex m;
+		std::condition_variable cv;
+	};
+
+	std::vector<std::thread> workers;
+	std::deque<std::shared_ptr<Task>> queue;
+	std::mutex m;
+	std::condition_variable cv;
+	bool stopping = false;
+
+	void work() {
+		while (1) {
+			std::shared_ptr<Task> task;
+			{
+				std::unique_lock<std::mutex> lock(m);
+				cv.wait(lock, [this]() {
+					return stopping || !queue.empty();
+				});
+				if (queue.empty())
+					return;
+				task = queue.front();
+				queue.pop_front();
+			}
+			if (task->taken.exchange(true))
+				continue;
+			task->run();
+			{
+				std::lock_guard<std::mutex> lock(task->m);
+				task->done = true;
+			}
+			task->cv.notify_all();
+		}
+	}
+
+public:
+	class Handle {
+	private:
+		std::shared_ptr<Task> task;
+
+	public:
+		Handle(std::shared_ptr<Task> task) : task(task) {}
+
+		// Waits for the task, or runs it here if no worker has taken it yet
+		void join() {
+			if (!task->taken.exchange(true)) {
+				task->run();
+				return;
+			}
+			std::unique_lock<std::mutex> lock(task->m);
+			task->cv.wait(lock, [this]() {
+				return task->done;
+			});
+		}
+	};
+
+	explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency()) {
+		if (threads == 0)
+			threads = 1;
+		for (unsigned i = 0; i < threads; i++)
+			workers.emplace_back([this]() {
+				work();
+			});
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(m);
+			stopping = true;
+		}
+		cv.notify_all();
+		for (auto &w : workers)
+			w.join();
+	}
+
+	// The task must be joined before anything it refers to goes away
+	template< class Function_t >
+	Handle fork(Function_t f) {
+		auto task = std::make_shared<Task>();
+		task->run = std::move(f);
+		{
+			std::lock_guard<std::mutex> lock(m);
+			queue.push_back(task);
+		}
+		cv.notify_one();
+		return Handle(task);
+	}
+
+	unsigned size() const {
+		return workers.size();
+	}
+
+	// The pool shared by everything which does not bring its own
+	static ThreadPool &shared() {
+		static ThreadPool pool;
+		return pool;
+	}
+};
+
+#endif /* THREADPOOL_HPP */
@@ -0,0 +1,268 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "TreeBase.hpp"
+#include "TreeFile.hpp"
+#include "Workload.hpp"
+
+/*
+The binary format of the traces: the header as in "TreeFile.hpp" (with the magic "TRAC",
+the format varint_delta or varint_strings and the count of the operations) and the
+operations one by one. An operation is the byte of its Operation and the key, except for
+clear, which has none; a scan is followed by its length as a varint. The integers are
+written as the difference from the previous key, zigzag encoded in a varint, so the near
+keys take a byte or two. The strings are written as the length in a varint followed by
+the characters.
+*/
+static const char trace_magic[4] = {'T', 'R', 'A', 'C'};
+
+// Writes the operations to the file through a large buffer; the count goes to the header at close
+template< class Key_t >
+class TraceWriter {
+	static_assert(std::is_integral<Key_t>::value || is_string_key<Key_t>::value,
+		"Only integers and strings can be traced");
+
+private:
+	static constexpr std::size_t buffer_size = 1 << 20;
+
+	std::fstream f;
+	std::vector<char> buffer;
+	TreeFileHeader header;
+	std::uint64_t previous = 0;
+
+	void putVarint(std::uint64_t value) {
+		while (value >= 0x80) {
+			buffer.push_back((char)(value | 0x80));
+			value >>= 7;
+		}
+		buffer.push_back((char)value);
+	}
+
+	void flush() {
+		f.write(buffer.data(), buffer.size());
+		buffer.clear();
+	}
+
+public:
+	explicit TraceWriter(const std::string &path) : f(path, f.out | f.binary | f.trunc) {
+		if (!f.is_open())
+			throw 1;
+		std::memcpy(header.magic, trace_magic, sizeof(trace_magic));
+		if constexpr (std::is_integral<Key_t>::value) {
+			header.format = varint_delta;
+			header.key_size = sizeof(Key_t);
+		}
+		else {
+			header.format = varint_strings;
+			header.key_size = sizeof(typename Key_t::value_type);
+		}
+		f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		buffer.reserve(buffer_size + 64);
+	}
+
+	TraceWriter(const TraceWriter &) = delete;
+	TraceWriter &operator=(const TraceWriter &) = delete;
+
+	~TraceWriter() {
+		try {
+			close();
+		}
+		catch (...) {}
+	}
+
+	void write(Operation op, const Key_t &key = Key_t(), int scan_length = 0) {
+		buffer.push_back((char)op);
+		if (op != Operation::clear) {
+			if constexpr (std::is_integral<Key_t>::value) {
+				std::int64_t delta = (std::int64_t)((std::uint64_t)key - previous);
+				putVarint(((std::uint64_t)delta << 1) ^ (std::uint64_t)(delta >> 63));
+				previous = (std::uint64_t)key;
+			}
+			else {
+				putVarint(key.size());
+				const char *data = reinterpret_cast<const char*>(key.data());
+				buffer.insert(buffer.end(), data, data + key.size() * sizeof(typename Key_t::value_type));
+			}
+		}
+		if (op == Operation::scan)
+			putVarint(scan_length);
+		header.count++;
+		if (buffer.size() >= buffer_size)
+			flush();
+	}
+
+	void close() {
+		if (!f.is_open())
+			return;
+		flush();
+		f.seekp(0);
+		f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		f.close();
+		if (f.fail())
+			throw 1;
+	}
+};
+
+/*
+Reads the operations of a trace from the mapped file as they go, so a trace of any
+length takes no memory but the pages being read. The key given by next() is valid
+until the following call.
+*/
+template< class Key_t >
+class TraceReader {
+	static_assert(std::is_integral<Key_t>::value || is_string_key<Key_t>::value,
+		"Only integers and strings can be traced");
+
+private:
+	MappedFile file;
+	const char *pos, *end;
+	std::uint64_t left;
+	std::uint64_t previous = 0;
+	Key_t key;
+
+	std::uint64_t getVarint() {
+		std::uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (pos == end)
+				throw 1;
+			unsigned char byte = *pos++;
+			value |= (std::uint64_t)(byte & 0x7f) << shift;
+			if (byte < 0x80)
+				return value;
+		}
+		throw 1;
+	}
+
+public:
+	explicit TraceReader(const std::string &path) : file(path) {
+		TreeFileHeader header;
+		if (file.size() < sizeof(header))
+			throw 1;
+		std::memcpy(&header, file.begin(), sizeof(header));
+		if (std::memcmp(header.magic, trace_magic, sizeof(trace_magic)) != 0)
+			throw 1;
+		if constexpr (std::is_integral<Key_t>::value) {
+			if (header.format != varint_delta || header.key_size != sizeof(Key_t))
+				throw 1;
+		}
+		else if (header.format != varint_strings || header.key_size != sizeof(typename Key_t::value_type))
+			throw 1;
+		pos = file.begin() + sizeof(header);
+		end = file.begin() + file.size();
+		left = header.count;
+	}
+
+	std::uint64_t remaining() const {
+		return left;
+	}
+
+	// Returns false at the end of the trace
+	bool next(Operation &op, const Key_t *&key_ptr, int &scan_length) {
+		if (left == 0)
+			return false;
+		if (pos == end || (unsigned char)*pos > (unsigned char)Operation::clear)
+			throw 1;
+		op = (Operation)*pos++;
+		if (op != Operation::clear) {
+			if constexpr (std::is_integral<Key_t>::value) {
+				std::uint64_t zigzag = getVarint();
+				previous += (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+				key = (Key_t)previous;
+			}
+			else {
+				typedef typename Key_t::value_type char_type;
+				std::uint64_t len = getVarint();
+				if ((std::size_t)(end - pos) / sizeof(char_type) < len)
+					throw 1;
+				key.resize(len);
+				std::memcpy(&key[0], pos, len * sizeof(char_type));
+				pos += len * sizeof(char_type);
+			}
+		}
+		scan_length = (op == Operation::scan ? (int)getVarint() : 0);
+		key_ptr = &key;
+		left--;
+		return true;
+	}
+};
+
+// Writes the workload as a trace: the insertions of its keys and then its operations
+template< class Key_t >
+void saveWorkload(const std::string &path, const Workload<Key_t> &workload) {
+	TraceWriter<Key_t> writer(path);
+	for (auto &key : workload.load_keys)
+		writer.write(Operation::insert, key);
+	for (auto &op : workload.operations)
+		writer.write(op.first, op.second, workload.scanLength());
+	writer.close();
+}
+
+/*
+A tree which writes every change and lookup it receives to a trace, so the traffic of a
+program can be replayed on any of the trees later ("--replay"). The recording costs
+about a buffered write of a few bytes per operation.
+*/
+template< class Tree_t >
+class TraceRecorder : public TreeBase<typename Tree_t::key_type, typename Tree_t::key_compare> {
+private:
+	typedef typename Tree_t::key_type Key_t;
+
+	Tree_t tree;
+	mutable TraceWriter<Key_t> writer;
+
+public:
+	typedef typename Tree_t::key_type key_type;
+	typedef typename Tree_t::key_compare key_compare;
+
+	template< class... Args >
+	explicit TraceRecorder(const std::string &path, Args&&... args)
+			: tree(std::forward<Args>(args)...), writer(path) {}
+
+	void insert(const Key_t &key) {
+		writer.write(Operation::insert, key);
+		tree.insert(key);
+	}
+
+	bool contains(const Key_t &key) const {
+		writer.write(Operation::lookup, key);
+		return tree.contains(key);
+	}
+
+	void erase(const Key_t &key) {
+		writer.write(Operation::erase, key);
+		tree.erase(key);
+	}
+
+	int size() const {
+		return tree.size();
+	}
+
+	void clear() {
+		writer.write(Operation::clear);
+		tree.clear();
+	}
+
+	void print() const {
+		tree.print();
+	}
+
+	// The tree itself, whose calls are not recorded
+	const Tree_t &base() const {
+		return tree;
+	}
+
+	// Writes the rest of the trace out; the destructor does it too
+	void close() {
+		writer.close();
+	}
+};
+
+#endif /* TRACE_HPP */
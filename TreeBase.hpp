@@ -1,16 +1,38 @@
 #ifndef TREEBASE_HPP
 #define TREEBASE_HPP
 
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+/*
+The interface of all the trees: insert, contains, erase, size, clear and print.
+The calls are not virtual, so the code generic over the trees takes the tree type
+as a template parameter, checked by is_tree, and the calls are inlined. AnyTree
+(see "AnyTree.hpp") holds a tree of a type chosen at run time.
+*/
 template< class Key_t, class Compare_t = std::less<Key_t> >
 class TreeBase {
 public:
-	virtual void insert(const Key_t &key) = 0;
-	virtual bool contains(const Key_t &key) const = 0;
-	virtual void erase(const Key_t &key) = 0;
-	virtual int size() const = 0;
-	virtual void print() const = 0;
 	typedef Key_t key_type;
 	typedef Compare_t key_compare;
 };
 
+template< class Tree_t, class = void >
+struct is_tree : std::false_type {};
+
+// What a concept of a tree would require
+template< class Tree_t >
+struct is_tree<Tree_t, std::void_t<typename Tree_t::key_type,
+		decltype(std::declval<Tree_t&>().insert(std::declval<const typename Tree_t::key_type&>())),
+		decltype(std::declval<Tree_t&>().erase(std::declval<const typename Tree_t::key_type&>())),
+		decltype(std::declval<Tree_t&>().clear()),
+		decltype(std::declval<const Tree_t&>().print())>>
+	: std::bool_constant<
+		std::is_convertible<decltype(std::declval<const Tree_t&>().contains(std::declval<const typename Tree_t::key_type&>())), bool>::value &&
+		std::is_convertible<decltype(std::declval<const Tree_t&>().size()), int>::value> {};
+
+template< class Tree_t >
+constexpr bool is_tree_v = is_tree<Tree_t>::value;
+
 #endif /* TREEBASE_HPP */
@@ -0,0 +1,167 @@
+#ifndef TREEFILE_HPP
+#define TREEFILE_HPP
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+The binary format of the saved trees: the header and the keys in order. The keys which are
+trivially copyable are written as they lie in memory, so a mapped file is an array of them.
+The strings are written as the length (32 bits) followed by the characters. The tree is
+built from the sorted keys in one pass, so the shape is not saved.
+*/
+struct TreeFileHeader {
+	char magic[4] = {'T', 'R', 'E', 'E'};
+	std::uint32_t format = 0;
+	std::uint64_t key_size = 0;
+	std::uint64_t count = 0;
+	std::uint64_t reserved[5] = {}; // The keys start at 64 bytes, aligned for any of them
+};
+
+enum TreeFileFormat : std::uint32_t {
+	raw_keys = 1,
+	string_keys = 2,
+	varint_delta = 3,  // The integers of the traces (see "Trace.hpp")
+	varint_strings = 4 // The strings of the traces, whose lengths are varints
+};
+
+template< class Key_t >
+struct is_string_key : std::false_type {};
+
+template< class Char_t, class Traits_t, class Allocator_t >
+struct is_string_key<std::basic_string<Char_t, Traits_t, Allocator_t>> : std::true_type {};
+
+// A file mapped to memory for reading, unmapped by the destructor
+class MappedFile {
+private:
+	void *data = nullptr;
+	std::size_t length = 0;
+
+public:
+	explicit MappedFile(const std::string &path) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw 1;
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			close(fd);
+			throw 1;
+		}
+		length = st.st_size;
+		if (length > 0) {
+			data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data == MAP_FAILED) {
+				close(fd);
+				throw 1;
+			}
+			madvise(data, length, MADV_SEQUENTIAL);
+		}
+		close(fd);
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	~MappedFile() {
+		if (data != nullptr)
+			munmap(data, length);
+	}
+
+	const char *begin() const {
+		return static_cast<const char*>(data);
+	}
+
+	std::size_t size() const {
+		return length;
+	}
+};
+
+// Writes n keys of [first, last), which must be sorted and unique
+template< class Key_t, class Iterator_t >
+void saveKeys(const std::string &path, Iterator_t first, Iterator_t last, std::size_t n) {
+	static_assert(std::is_trivially_copyable<Key_t>::value || is_string_key<Key_t>::value,
+		"Only trivially copyable keys and strings can be saved");
+	std::fstream f(path, f.out | f.binary | f.trunc);
+	if (!f.is_open())
+		throw 1;
+	TreeFileHeader header;
+	header.count = n;
+	if constexpr (std::is_trivially_copyable<Key_t>::value) {
+		header.format = raw_keys;
+		header.key_size = sizeof(Key_t);
+	}
+	else {
+		header.format = string_keys;
+		header.key_size = sizeof(typename Key_t::value_type);
+	}
+	f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (; first != last; ++first) {
+		const Key_t &key = *first;
+		if constexpr (std::is_trivially_copyable<Key_t>::value)
+			f.write(reinterpret_cast<const char*>(&key), sizeof(Key_t));
+		else {
+			std::uint32_t len = key.size();
+			f.write(reinterpret_cast<const char*>(&len), sizeof(len));
+			f.write(reinterpret_cast<const char*>(key.data()), len * sizeof(typename Key_t::value_type));
+		}
+	}
+	f.close();
+	if (f.fail())
+		throw 1;
+}
+
+/*
+Maps the file and calls build(first, last) for its keys. The trivially copyable keys are
+given right from the mapped memory, the strings are read out first.
+*/
+template< class Key_t, class Function_t >
+void loadKeys(const std::string &path, Function_t build) {
+	MappedFile file(path);
+	TreeFileHeader header, expected;
+	if (file.size() < sizeof(header))
+		throw 1;
+	std::memcpy(&header, file.begin(), sizeof(header));
+	if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0)
+		throw 1;
+	const char *pos = file.begin() + sizeof(header), *end = file.begin() + file.size();
+
+	if constexpr (std::is_trivially_copyable<Key_t>::value) {
+		if (header.format != raw_keys || header.key_size != sizeof(Key_t) || (std::size_t)(end - pos) / sizeof(Key_t) < header.count)
+			throw 1;
+		const Key_t *keys = reinterpret_cast<const Key_t*>(pos);
+		build(keys, keys + header.count);
+	}
+	else {
+		static_assert(is_string_key<Key_t>::value, "Only trivially copyable keys and strings can be loaded");
+		typedef typename Key_t::value_type char_type;
+		if (header.format != string_keys || header.key_size != sizeof(char_type))
+			throw 1;
+		std::vector<Key_t> keys;
+		keys.reserve(std::min<std::uint64_t>(header.count, (end - pos) / sizeof(std::uint32_t)));
+		for (std::uint64_t i = 0; i < header.count; i++) {
+			std::uint32_t len;
+			if ((std::size_t)(end - pos) < sizeof(len))
+				throw 1;
+			std::memcpy(&len, pos, sizeof(len));
+			pos += sizeof(len);
+			if ((std::size_t)(end - pos) / sizeof(char_type) < len)
+				throw 1;
+			keys.emplace_back(len, char_type());
+			std::memcpy(&keys.back()[0], pos, len * sizeof(char_type));
+			pos += len * sizeof(char_type);
+		}
+		build(keys.begin(), keys.end());
+	}
+}
+
+#endif /* TREEFILE_HPP */
@@ -0,0 +1,68 @@
+#ifndef TREEITERATOR_HPP
+#define TREEITERATOR_HPP
+
+#include <cstddef>
+#include <iterator>
+
+// Bidirectional in-order iterator. The end is the null node; the tree root is kept to step back from it.
+template< class Node_t, class Value_t = const typename Node_t::data_type >
+class TreeIterator {
+private:
+	Node_t *node = nullptr;
+	Node_t *const *root = nullptr;
+
+public:
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef typename Node_t::data_type value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef Value_t *pointer;
+	typedef Value_t &reference;
+
+	TreeIterator() {}
+
+	TreeIterator(Node_t *node, Node_t *const *root) : node(node), root(root) {}
+
+	Node_t *getNode() const {
+		return node;
+	}
+
+	reference operator*() const {
+		return node->data;
+	}
+
+	pointer operator->() const {
+		return &node->data;
+	}
+
+	TreeIterator &operator++() {
+		node = node->next();
+		return *this;
+	}
+
+	TreeIterator operator++(int) {
+		TreeIterator tmp = *this;
+		node = node->next();
+		return tmp;
+	}
+
+	TreeIterator &operator--() {
+		node = (node == nullptr ? Node_t::rightmost(*root) : node->prev());
+		return *this;
+	}
+
+	TreeIterator operator--(int) {
+		TreeIterator tmp = *this;
+		--*this;
+		return tmp;
+	}
+
+	bool operator==(const TreeIterator &other) const {
+		return node == other.node;
+	}
+
+	bool operator!=(const TreeIterator &other) const {
+		return node != other.node;
+	}
+};
+
+#endif /* TREEITERATOR_HPP */
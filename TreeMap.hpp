@@ -0,0 +1,106 @@
+#ifndef TREEMAP_HPP
+#define TREEMAP_HPP
+
+#include <utility>
+#include <tuple>
+
+// Map interface over a balanced tree whose elements are pairs of a key and a mapped value
+template< class Tree_t >
+class TreeMap : public Tree_t {
+protected:
+	typedef typename Tree_t::node_t node_t;
+
+public:
+	typedef typename Tree_t::key_type key_type;
+	typedef typename Tree_t::value_type value_type;
+	typedef typename value_type::second_type mapped_type;
+	typedef typename Tree_t::iterator iterator;
+
+	using Tree_t::Tree_t;
+
+	// Inserts the key with a default constructed value
+	void insert(const key_type &key) {
+		try_emplace(key);
+	}
+
+	std::pair<iterator, bool> insert(const value_type &value) {
+		auto res = this->insertWith(value.first, [&]() {
+			return node_t::create(this->alloc, value);
+		});
+		return {iterator(res.first, &this->root), res.second};
+	}
+
+	std::pair<iterator, bool> insert(value_type &&value) {
+		auto res = this->insertWith(value.first, [&]() {
+			return node_t::create(this->alloc, std::move(value));
+		});
+		return {iterator(res.first, &this->root), res.second};
+	}
+
+	// The element is built in a new node first, which is dropped if the key is already there
+	template< class... Args >
+	std::pair<iterator, bool> emplace(Args&&... args) {
+		node_t *node = node_t::create(this->alloc, std::forward<Args>(args)...);
+		auto res = this->insertWith(Tree_t::keyOf(node), [node]() {
+			return node;
+		});
+		if (!res.second)
+			node_t::destroy(node, this->alloc);
+		return {iterator(res.first, &this->root), res.second};
+	}
+
+	// Nothing is constructed if the key is already there
+	template< class... Args >
+	std::pair<iterator, bool> try_emplace(const key_type &key, Args&&... args) {
+		auto res = this->insertWith(key, [&]() {
+			return node_t::create(this->alloc, std::piecewise_construct, std::forward_as_tuple(key),
+				std::forward_as_tuple(std::forward<Args>(args)...));
+		});
+		return {iterator(res.first, &this->root), res.second};
+	}
+
+	template< class... Args >
+	std::pair<iterator, bool> try_emplace(key_type &&key, Args&&... args) {
+		auto res = this->insertWith(key, [&]() {
+			return node_t::create(this->alloc, std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+				std::forward_as_tuple(std::forward<Args>(args)...));
+		});
+		return {iterator(res.first, &this->root), res.second};
+	}
+
+	template< class M >
+	std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+		auto res = try_emplace(key, std::forward<M>(obj));
+		if (!res.second) {
+			res.first.getNode()->data.second = std::forward<M>(obj);
+			res.first.getNode()->updateUp();
+		}
+		return res;
+	}
+
+	template< class M >
+	std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+		auto res = try_emplace(std::move(key), std::forward<M>(obj));
+		if (!res.second) {
+			res.first.getNode()->data.second = std::forward<M>(obj);
+			res.first.getNode()->updateUp();
+		}
+		return res;
+	}
+
+	/*
+	A change through the reference would leave the aggregates of the subtrees stale, so with
+	an aggregate the values are changed only by insert_or_assign, which updates them.
+	*/
+	mapped_type &operator[](const key_type &key) {
+		static_assert(!node_t::aggregated, "The map has an aggregate, use insert_or_assign");
+		return try_emplace(key).first.getNode()->data.second;
+	}
+
+	mapped_type &operator[](key_type &&key) {
+		static_assert(!node_t::aggregated, "The map has an aggregate, use insert_or_assign");
+		return try_emplace(std::move(key)).first.getNode()->data.second;
+	}
+};
+
+#endif /* TREEMAP_HPP */
@@ -0,0 +1,62 @@
+#ifndef TREESET_HPP
+#define TREESET_HPP
+
+#include <utility>
+#include <cstddef>
+#include <string>
+
+#include "TreeFile.hpp"
+
+// Set interface over a balanced tree whose elements are the keys themselves
+template< class Tree_t >
+class TreeSet : public Tree_t {
+protected:
+	typedef typename Tree_t::node_t node_t;
+
+public:
+	typedef typename Tree_t::key_type key_type;
+	typedef typename Tree_t::iterator iterator;
+
+	using Tree_t::Tree_t;
+
+	void insert(const key_type &key) {
+		this->insertWith(key, [&]() {
+			return node_t::create(this->alloc, key);
+		});
+	}
+
+	void insert(key_type &&key) {
+		this->insertWith(key, [&]() {
+			return node_t::create(this->alloc, std::move(key));
+		});
+	}
+
+	// Writes the keys in order to the file, see "TreeFile.hpp"
+	void save(const std::string &path) const {
+		saveKeys<key_type>(path, this->begin(), this->end(), this->size());
+	}
+
+	/*
+	Replaces the contents by the keys saved to the file. The file is mapped, and the tree
+	is built in one pass over them, with no searches.
+	*/
+	void load(const std::string &path) {
+		loadKeys<key_type>(path, [this](auto first, auto last) {
+			this->build(first, last);
+		});
+	}
+
+	// The key is built in a new node first, which is dropped if the key is already there
+	template< class... Args >
+	std::pair<iterator, bool> emplace(Args&&... args) {
+		node_t *node = node_t::create(this->alloc, std::forward<Args>(args)...);
+		auto res = this->insertWith(Tree_t::keyOf(node), [node]() {
+			return node;
+		});
+		if (!res.second)
+			node_t::destroy(node, this->alloc);
+		return {iterator(res.first, &this->root), res.second};
+	}
+};
+
+#endif /* TREESET_HPP */
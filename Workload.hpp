@@ -0,0 +1,264 @@
+#ifndef WORKLOAD_HPP
+#define WORKLOAD_HPP
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// xoshiro256** seeded by splitmix64: fast, and the same sequence for the same seed
+class FastRandom {
+private:
+	std::uint64_t s[4];
+
+	static std::uint64_t rotl(std::uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+public:
+	typedef std::uint64_t result_type;
+
+	explicit FastRandom(std::uint64_t seed = 1) {
+		for (auto &word : s) {
+			std::uint64_t z = (seed += 0x9e3779b97f4a7c15);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			word = z ^ (z >> 31);
+		}
+	}
+
+	std::uint64_t operator()() {
+		std::uint64_t res = rotl(s[1] * 5, 7) * 9;
+		std::uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return res;
+	}
+
+	// Uniform in [0, n)
+	std::uint64_t uniform(std::uint64_t n) {
+		return (std::uint64_t)(((unsigned __int128)(*this)() * n) >> 64);
+	}
+
+	// Uniform in [0, 1)
+	double real() {
+		return ((*this)() >> 11) * 0x1.0p-53;
+	}
+
+	static constexpr std::uint64_t min() {
+		return 0;
+	}
+
+	static constexpr std::uint64_t max() {
+		return std::numeric_limits<std::uint64_t>::max();
+	}
+};
+
+/*
+Zipfian ranks in [0, n): the rank r comes with the probability proportional to 1/(r + 1)^theta.
+The method of Gray et al. ("Quickly generating billion-record synthetic databases"), as in YCSB.
+*/
+class ZipfGenerator {
+private:
+	std::uint64_t n;
+	double theta, alpha, zetan, eta, half_pow;
+
+	static double zeta(std::uint64_t n, double theta) {
+		double sum = 0;
+		for (std::uint64_t i = 1; i <= n; i++)
+			sum += 1 / std::pow((double)i, theta);
+		return sum;
+	}
+
+public:
+	ZipfGenerator(std::uint64_t n, double theta = 0.99) : n(n), theta(theta) {
+		double zeta2 = zeta(2, theta);
+		zetan = zeta(n, theta);
+		alpha = 1 / (1 - theta);
+		eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+		half_pow = 1 + std::pow(0.5, theta);
+	}
+
+	std::uint64_t operator()(FastRandom &rnd) const {
+		double u = rnd.real(), uz = u * zetan;
+		if (uz < 1)
+			return 0;
+		if (uz < half_pow)
+			return 1;
+		std::uint64_t res = (std::uint64_t)(n * std::pow(eta * u - eta + 1, alpha));
+		return (res < n ? res : n - 1);
+	}
+};
+
+// clear comes only from the traces (see "Trace.hpp"), the workloads do not make it
+enum class Operation : char {
+	lookup, insert, erase, scan, clear
+};
+
+// Percents of the operations
+struct WorkloadMix {
+	int lookup = 100, insert = 0, erase = 0, scan = 0;
+};
+
+/*
+How the keys are chosen. The new keys are random for uniform and zipf, growing for sequential,
+falling for reverse and come in runs of consecutive keys for clustered. The present keys are
+picked with the Zipf distribution (the hot keys scattered over the set) for zipf and evenly
+for the others.
+*/
+enum class KeyOrder {
+	uniform, zipf, sequential, reverse, clustered
+};
+
+struct WorkloadConfig {
+	WorkloadMix mix;
+	KeyOrder order = KeyOrder::zipf;
+	int load = 1000000;         // The keys inserted before the operations
+	int operations = 1000000;
+	double hit_ratio = 1;       // The part of the lookups made for present keys
+	int scan_length = 100;
+	double zipf_theta = 0.99;
+	int cluster = 64;
+	std::uint64_t seed = 1;
+};
+
+/*
+The mixes of the YCSB core workloads over a set: "a" is update heavy (an update is an erase
+and an insert here), "b" read mostly, "c" read only, "e" short scans. The workloads "d" and "f"
+need the latest keys and read-modify-write, which a set does not have. Returns false for
+an unknown name.
+*/
+inline bool workloadPreset(const std::string &name, WorkloadMix &mix) {
+	if (name == "a")
+		mix = {50, 25, 25, 0};
+	else if (name == "b")
+		mix = {95, 5, 0, 0};
+	else if (name == "c")
+		mix = {100, 0, 0, 0};
+	else if (name == "e")
+		mix = {0, 5, 0, 95};
+	else
+		return false;
+	return true;
+}
+
+// Keys keep the order of the numbers: the integers as they are, the strings with leading zeros
+template< class Key_t >
+Key_t makeKey(std::uint64_t value) {
+	if constexpr (std::is_integral<Key_t>::value)
+		return (Key_t)value;
+	else {
+		std::string digits = std::to_string(value);
+		return Key_t(20 - digits.size(), '0') + Key_t(digits.begin(), digits.end());
+	}
+}
+
+/*
+The keys to load and the operations to run on them, generated in advance. The present
+keys are followed as the operations go, so the erases and the lookups for present keys
+find them, if the keys are random and do not repeat by chance.
+*/
+template< class Key_t >
+class Workload {
+private:
+	WorkloadConfig config;
+	FastRandom rnd;
+	ZipfGenerator zipf;
+	std::vector<std::uint64_t> present;
+	std::uint64_t universe, next_key, cluster_left = 0;
+
+	std::uint64_t newKey() {
+		switch (config.order) {
+		case KeyOrder::sequential:
+			return next_key++;
+		case KeyOrder::reverse:
+			return next_key--;
+		case KeyOrder::clustered:
+			if (cluster_left == 0) {
+				next_key = rnd.uniform(universe - config.cluster);
+				cluster_left = config.cluster;
+			}
+			cluster_left--;
+			return next_key++;
+		default:
+			return rnd.uniform(universe);
+		}
+	}
+
+	// The index of a present key
+	std::size_t pick() {
+		if (config.order != KeyOrder::zipf)
+			return rnd.uniform(present.size());
+		// The ranks are scattered, so the hot keys are not neighbours
+		std::uint64_t rank = zipf(rnd);
+		return (rank * 0x9e3779b97f4a7c15 >> 17) % present.size();
+	}
+
+	Operation choose() {
+		int p = rnd.uniform(100);
+		if (p < config.mix.lookup)
+			return Operation::lookup;
+		p -= config.mix.lookup;
+		if (p < config.mix.insert)
+			return Operation::insert;
+		p -= config.mix.insert;
+		if (p < config.mix.erase)
+			return Operation::erase;
+		return Operation::scan;
+	}
+
+public:
+	std::vector<Key_t> load_keys;
+	std::vector<std::pair<Operation, Key_t>> operations;
+
+	explicit Workload(const WorkloadConfig &config)
+			: config(config), rnd(config.seed), zipf(config.load > 2 ? config.load : 2, config.zipf_theta) {
+		if (config.mix.lookup + config.mix.insert + config.mix.erase + config.mix.scan != 100)
+			throw 1;
+		if constexpr (std::is_integral<Key_t>::value)
+			universe = std::numeric_limits<Key_t>::max();
+		else
+			universe = (std::uint64_t)1 << 62;
+		next_key = (config.order == KeyOrder::reverse ? universe - 1 : 0);
+
+		for (int i = 0; i < config.load; i++) {
+			present.push_back(newKey());
+			load_keys.push_back(makeKey<Key_t>(present.back()));
+		}
+
+		for (int i = 0; i < config.operations; i++) {
+			Operation op = choose();
+			if ((op == Operation::erase || op == Operation::scan) && present.empty())
+				op = Operation::insert;
+			std::uint64_t key;
+			if (op == Operation::insert) {
+				key = newKey();
+				present.push_back(key);
+			}
+			else if (op == Operation::lookup && (present.empty() || rnd.real() >= config.hit_ratio))
+				key = newKey();
+			else {
+				std::size_t j = pick();
+				key = present[j];
+				if (op == Operation::erase) {
+					present[j] = present.back();
+					present.pop_back();
+				}
+			}
+			operations.push_back({op, makeKey<Key_t>(key)});
+		}
+	}
+
+	int scanLength() const {
+		return config.scan_length;
+	}
+};
+
+#endif /* WORKLOAD_HPP */
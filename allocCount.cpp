@@ -0,0 +1,106 @@
+/*
+ * Counts the heap allocations of the process and the bytes they hold by
+ * replacing the global operator new and delete. Linking this file in is
+ * enough to turn the counting on.
+ */
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <string>
+#include <malloc.h>
+
+static std::atomic<long long> alloc_count(0);
+static std::atomic<long long> live_bytes(0);
+
+void *operator new(std::size_t size)
+{
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    void *p = std::malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    // What malloc really gave, with the rounding up
+    live_bytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    if (p != nullptr)
+        live_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+/* The over-aligned objects, as the nodes of BPtree, are counted the same way */
+void *operator new(std::size_t size, std::align_val_t align)
+{
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    std::size_t a = static_cast<std::size_t>(align);
+    /* aligned_alloc wants the size to be a multiple of the alignment */
+    size = (size + a - 1) / a * a;
+    if (size == 0)
+        size = a;
+    void *p = std::aligned_alloc(a, size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    live_bytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+    return p;
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+    operator delete(p);
+}
+
+/**
+ * Returns the number of calls to operator new made so far.
+ */
+long long getAllocCount()
+{
+    return alloc_count.load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns the bytes held by the blocks from operator new which are not
+ * deleted yet.
+ */
+long long getLiveBytes()
+{
+    return live_bytes.load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns the peak resident set size of the process in bytes (VmHWM of
+ * /proc/self/status), or -1 if it cannot be read.
+ */
+long long getPeakRSS()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::stoll(line.substr(6)) * 1024;
+    return -1;
+}
+
+/**
+ * Makes the peak resident set size start again from the current one,
+ * where the kernel allows it (Linux 4.0 and later).
+ */
+void resetPeakRSS()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
@@ -0,0 +1,4 @@
+long long getAllocCount();
+long long getLiveBytes();
+long long getPeakRSS();
+void resetPeakRSS();
@@ -6,14 +6,21 @@ matplotlib.use('GTK3Cairo')
 import matplotlib.pyplot as plt
 import pandas as pd
 import sys
+import os
 
 avl_file = 'out/avl.tsv'
 rb_file = 'out/rb.tsv'
 
 avl = pd.read_csv(avl_file, sep='\t')
 rb = pd.read_csv(rb_file, sep='\t')
+trees = [avl, rb]
+names = ['avl', 'rb']
+# The B+ tree, if it was profiled
+if os.path.exists('out/bp.tsv'):
+	trees.append(pd.read_csv('out/bp.tsv', sep='\t'))
+	names.append('bp')
 
-for tree, name in zip([avl, rb], ['avl', 'rb']):
+for tree, name in zip(trees, names):
 	fig = plt.figure()
 	ax = fig.add_subplot(1, 1, 1)
 
@@ -30,10 +37,68 @@ for method, size_name in zip(['insertion', 'access', 'deletion'], ['size_ins', '
 	fig = plt.figure()
 	ax = fig.add_subplot(1, 1, 1)
 
-	for tree, name in zip([avl, rb], ['avl', 'rb']):
+	for tree, name in zip(trees, names):
 		ax.plot(tree[size_name]/10**4, tree[method]*10**6, label=name)
 	ax.set_xlabel('$n, \ 10^4$')
 	ax.set_ylabel('$time, \ ms$', y=1, rotation=0)
 	ax.legend()
 
 	fig.savefig('out/' + method + '.png', format='png')
+
+fig = plt.figure()
+ax = fig.add_subplot(1, 1, 1)
+for tree, name in zip(trees, names):
+	ax.plot(tree['size_ins']/10**4, tree['bytes_per_key'], label=name)
+	ax.plot(tree['size_ins']/10**4, tree['heap_bytes_per_key'], '--', label=name + ' heap')
+ax.set_xlabel('$n, \ 10^4$')
+ax.set_ylabel('$bytes/key$', y=1, rotation=0)
+ax.legend()
+fig.savefig('out/memory.png', format='png')
+
+# Pool allocator against the plain heap, if "./tree --compare-alloc" was run
+if os.path.exists('out/avl_heap.tsv') and os.path.exists('out/rb_heap.tsv'):
+	avl_heap = pd.read_csv('out/avl_heap.tsv', sep='\t')
+	rb_heap = pd.read_csv('out/rb_heap.tsv', sep='\t')
+	for method, size_name in zip(['insertion', 'access', 'deletion'], ['size_ins', 'size_acc', 'size_del']):
+		fig = plt.figure()
+		ax = fig.add_subplot(1, 1, 1)
+
+		for tree, name in zip([avl, rb, avl_heap, rb_heap], ['avl', 'rb', 'avl heap', 'rb heap']):
+			ax.plot(tree[size_name]/10**4, tree[method]*10**6, label=name)
+		ax.set_xlabel('$n, \ 10^4$')
+		ax.set_ylabel('$time, \ ms$', y=1, rotation=0)
+		ax.legend()
+
+		fig.savefig('out/' + method + '_alloc.png', format='png')
+
+# Range scans, if "./tree --scan" was run
+if os.path.exists('out/avl_scan.tsv') and os.path.exists('out/rb_scan.tsv'):
+	fig = plt.figure()
+	ax = fig.add_subplot(1, 1, 1)
+	for name in names:
+		scan = pd.read_csv('out/' + name + '_scan.tsv', sep='\t')
+		ax.plot(scan['length'], scan['keys_per_sec']/10**6, label=name)
+	ax.set_xscale('log')
+	ax.set_xlabel('$scan \ length$')
+	ax.set_ylabel('$10^6 \ keys/s$', y=1, rotation=0)
+	ax.legend()
+	fig.savefig('out/scan.png', format='png')
+
+# Latency percentiles, if "./tree --latency" was run
+if os.path.exists('out/avl_latency.tsv') and os.path.exists('out/rb_latency.tsv'):
+	latency_names = [name for name in names if os.path.exists('out/' + name + '_latency.tsv')]
+	latencies = [pd.read_csv('out/' + name + '_latency.tsv', sep='\t') for name in latency_names]
+	for method in ['insertion', 'access', 'deletion']:
+		fig = plt.figure()
+		ax = fig.add_subplot(1, 1, 1)
+
+		for latency, name in zip(latencies, latency_names):
+			rows = latency[latency['operation'] == method]
+			for percentile in ['p50', 'p99', 'p99.9']:
+				ax.plot(rows['size']/10**4, rows[percentile]/10**3, label=name + ' ' + percentile)
+		ax.set_yscale('log')
+		ax.set_xlabel('$n, \ 10^4$')
+		ax.set_ylabel(r'$latency, \ \mu s$', y=1, rotation=0)
+		ax.legend()
+
+		fig.savefig('out/' + method + '_latency.png', format='png')
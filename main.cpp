@@ -2,11 +2,17 @@
 #include <getopt.h>
 #include <filesystem>
 #include <string>
-#include <random>
+#include <memory>
+#include <map>
+#include <sstream>
 
 #include "TreeBase.hpp"
+#include "AnyTree.hpp"
 #include "AVLtree.hpp"
 #include "RBtree.hpp"
+#include "BPtree.hpp"
+#include "Workload.hpp"
+#include "Trace.hpp"
 #include "Profiler.hpp"
 
 using std::cin;
@@ -15,15 +21,14 @@ using std::cerr;
 using std::filesystem::create_directory;
 using std::filesystem::exists;
 using std::string;
-using std::random_device;
 using std::stoi;
+using std::vector;
 
-template< class Tree >
-void game() {
-	Tree K;
+template< class Key >
+void game(AnyTree<Key> &K) {
 	while (1) {
 		char ch;
-		typename Tree::key_type k;
+		Key k;
 		cin >> ch;
 		switch (ch) {
 		case 'a':
@@ -46,58 +51,135 @@ void game() {
 	}
 }
 
+template< class Key, class Tree >
+AnyTree<Key> makeTree(const string &trace) {
+	if (trace.empty())
+		return AnyTree<Key>(std::in_place_type<Tree>);
+	return AnyTree<Key>(std::in_place_type<TraceRecorder<Tree>>, trace);
+}
+
+// The type must be avl, rb or bp; the operations are written to the trace, if it is given
+template< class Key >
+AnyTree<Key> makeTree(const string &type, const string &trace) {
+	if (type == "avl")
+		return makeTree<Key, AVLtree<Key>>(trace);
+	if (type == "rb")
+		return makeTree<Key, RBtree<Key>>(trace);
+	return makeTree<Key, BPtree<Key>>(trace);
+}
+
 static const int max_str_len = 10;
+static const int max_long_str_len = 64;
 
 struct getRandomString {
+	int max_len;
+	FastRandom rnd;
+
+	getRandomString(int max_len = max_str_len) : max_len(max_len) {}
+
 	string operator()() {
-		random_device rnd;
-		int len = rnd() % max_str_len;
-		char str[max_str_len + 1];
+		int len = rnd() % max_len;
+		string str(len, ' ');
 		for (int i = 0; i < len; i++)
 			str[i] = (char)rnd();
-		str[len] = 0;
-		return str;
+		// Cut at the first zero character
+		return str.c_str();
 	}
 };
 
+static const vector<int> scan_lengths = {1, 10, 100, 1000, 10000, 100000};
+
+static const int map_value_len = 256;
+
+static const std::map<string, KeyOrder> key_orders = {{"uniform", KeyOrder::uniform}, {"zipf", KeyOrder::zipf},
+	{"sequential", KeyOrder::sequential}, {"reverse", KeyOrder::reverse}, {"clustered", KeyOrder::clustered}};
+
 static const int general_failure_err = 2;
 static const int incorrect_usage_err = 1;
 
 void usage() {
-	cerr << "Usage: tree [--string] [--game avl|rb]\n";
+	cerr << "Usage: tree [--string] [--game avl|rb|bp] [--compare-alloc] [--scan] [--map] [--build] [--batch] [--union] [--frozen] [--concurrent] [--sharded] [--persistent] [--dispatch] [--load] [--latency] [--counters] [--lookup]\n"
+		"            [--workload a|b|c|e] [--mix lookup,insert,erase,scan] [--keys uniform|zipf|sequential|reverse|clustered]\n"
+		"            [--hit-ratio ratio] [--ops count] [--seed seed] [--record trace] [--replay trace] [-n max_size]\n";
 	exit(incorrect_usage_err);
 }
 
 int main(int argc, char *argv[]) {
 	int opt_index = -1;
-	int is_game = 0, use_str = 0;
-	string tree_type;
+	int is_game = 0, use_str = 0, compare_alloc = 0, scan = 0, map = 0, build = 0, batch = 0, merge = 0, frozen = 0, concurrent = 0, sharded = 0, persistent = 0, dispatch = 0, load = 0, latency = 0, use_counters = 0, workload = 0, lookup = 0;
+	WorkloadConfig config;
+	bool has_ops = false;
+	string tree_type, record_path, replay_path;
 	int max_size = 1000000;
 
-	option options[] = {{"game", required_argument, &is_game, 1}, {"string", no_argument, &use_str, 1}};
+	option options[] = {{"game", required_argument, &is_game, 1}, {"string", no_argument, &use_str, 1},
+		{"compare-alloc", no_argument, &compare_alloc, 1}, {"scan", no_argument, &scan, 1},
+		{"map", no_argument, &map, 1}, {"build", no_argument, &build, 1},
+		{"batch", no_argument, &batch, 1}, {"union", no_argument, &merge, 1},
+		{"frozen", no_argument, &frozen, 1}, {"concurrent", no_argument, &concurrent, 1},
+		{"sharded", no_argument, &sharded, 1}, {"persistent", no_argument, &persistent, 1},
+		{"dispatch", no_argument, &dispatch, 1}, {"load", no_argument, &load, 1},
+		{"latency", no_argument, &latency, 1}, {"counters", no_argument, &use_counters, 1},
+		{"lookup", no_argument, &lookup, 1},
+		{"workload", required_argument, 0, 'w'}, {"mix", required_argument, 0, 'm'}, {"keys", required_argument, 0, 'k'},
+		{"hit-ratio", required_argument, 0, 'h'}, {"ops", required_argument, 0, 'o'}, {"seed", required_argument, 0, 's'},
+		{"record", required_argument, 0, 'r'}, {"replay", required_argument, 0, 'p'},
+		{0, 0, 0, 0}};
 	char ch;
 	while ((ch = getopt_long(argc, argv, "n:", options, &opt_index)) != -1) {
-		if (opt_index == 0)
+		if (ch == 0 && opt_index == 0)
 			tree_type = optarg;
 		if (ch == 'n')
 			max_size = stoi(optarg);
+		if (ch == 'w') {
+			workload = 1;
+			if (!workloadPreset(optarg, config.mix))
+				usage();
+		}
+		if (ch == 'm') {
+			workload = 1;
+			char comma;
+			std::istringstream mix(optarg);
+			if (!(mix >> config.mix.lookup >> comma >> config.mix.insert >> comma >> config.mix.erase >> comma >> config.mix.scan) ||
+					config.mix.lookup + config.mix.insert + config.mix.erase + config.mix.scan != 100)
+				usage();
+		}
+		if (ch == 'k') {
+			auto order = key_orders.find(optarg);
+			if (order == key_orders.end())
+				usage();
+			config.order = order->second;
+		}
+		if (ch == 'h')
+			config.hit_ratio = std::stod(optarg);
+		if (ch == 'o') {
+			config.operations = stoi(optarg);
+			has_ops = true;
+		}
+		if (ch == 's')
+			config.seed = std::stoull(optarg);
+		if (ch == 'r')
+			record_path = optarg;
+		if (ch == 'p')
+			replay_path = optarg;
+		if (ch == '?')
+			usage();
 	}
+	config.load = max_size;
+	if (!has_ops)
+		config.operations = max_size;
 
 	if (is_game) {
-		if (tree_type == "avl") {
-			if (use_str)
-				game<AVLtree<string>>();
-			else
-				game<AVLtree<int>>();
-		}
-		else if (tree_type == "rb") {
-			if (use_str)
-				game<RBtree<string>>();
-			else
-				game<RBtree<int>>();
-		}
-		else
+		if (tree_type != "avl" && tree_type != "rb" && tree_type != "bp")
 			usage();
+		if (use_str) {
+			AnyTree<string> tree = makeTree<string>(tree_type, record_path);
+			game(tree);
+		}
+		else {
+			AnyTree<int> tree = makeTree<int>(tree_type, record_path);
+			game(tree);
+		}
 		return 0;
 	}
 
@@ -109,19 +191,302 @@ int main(int argc, char *argv[]) {
 
 	if (use_str) {
 		Profiler<AVLtree<string>, getRandomString> ap;
+		Profiler<RBtree<string>, getRandomString> rp;
+		Profiler<BPtree<string>, getRandomString> bp;
+		if (use_counters && !(ap.useCounters() && rp.useCounters() && bp.useCounters()))
+			cerr << "Hardware counters are not available, only the time is measured\n";
 		ap.measure(max_size);
 		ap.saveStats("out/avl.tsv");
-		Profiler<RBtree<string>, getRandomString> rp;
 		rp.measure(max_size);
 		rp.saveStats("out/rb.tsv");
+		bp.measure(max_size);
+		bp.saveStats("out/bp.tsv");
+		if (scan) {
+			ap.measureScan(max_size, scan_lengths);
+			ap.saveScanStats("out/avl_scan.tsv");
+			rp.measureScan(max_size, scan_lengths);
+			rp.saveScanStats("out/rb_scan.tsv");
+			bp.measureScan(max_size, scan_lengths);
+			bp.saveScanStats("out/bp_scan.tsv");
+		}
+		if (lookup) {
+			// Lookups by a borrowed string need long keys, short ones do not allocate anyway
+			Profiler<AVLtree<string, std::less<>>, getRandomString> alp{getRandomString(max_long_str_len)};
+			alp.measureBorrowedLookup(max_size);
+			alp.saveAllocStats("out/avl_lookup.tsv");
+			Profiler<RBtree<string, std::less<>>, getRandomString> rlp{getRandomString(max_long_str_len)};
+			rlp.measureBorrowedLookup(max_size);
+			rlp.saveAllocStats("out/rb_lookup.tsv");
+		}
+		if (merge) {
+			Profiler<AVLtree<string>, getRandomString> aup;
+			aup.measureUnion(max_size);
+			aup.saveAllocStats("out/avl_union.tsv");
+			Profiler<RBtree<string>, getRandomString> rup;
+			rup.measureUnion(max_size);
+			rup.saveAllocStats("out/rb_union.tsv");
+		}
+		if (!replay_path.empty()) {
+			Profiler<AVLtree<string>, getRandomString> arp;
+			arp.measureReplay(replay_path);
+			arp.saveThroughputStats("out/avl_replay.tsv");
+			arp.saveLatencyStats("out/avl_replay_latency.tsv");
+			Profiler<RBtree<string>, getRandomString> rrp;
+			rrp.measureReplay(replay_path);
+			rrp.saveThroughputStats("out/rb_replay.tsv");
+			rrp.saveLatencyStats("out/rb_replay_latency.tsv");
+			Profiler<BPtree<string>, getRandomString> brp;
+			brp.measureReplay(replay_path);
+			brp.saveThroughputStats("out/bp_replay.tsv");
+			brp.saveLatencyStats("out/bp_replay_latency.tsv");
+		}
+		if (workload) {
+			if (!record_path.empty())
+				saveWorkload(record_path, Workload<string>(config));
+			Profiler<AVLtree<string>, getRandomString> awp;
+			awp.measureWorkload(config);
+			awp.saveThroughputStats("out/avl_workload.tsv");
+			Profiler<RBtree<string>, getRandomString> rwp;
+			rwp.measureWorkload(config);
+			rwp.saveThroughputStats("out/rb_workload.tsv");
+			Profiler<BPtree<string>, getRandomString> bwp;
+			bwp.measureWorkload(config);
+			bwp.saveThroughputStats("out/bp_workload.tsv");
+		}
+		if (latency) {
+			Profiler<AVLtree<string>, getRandomString> alt;
+			alt.measureLatency(max_size);
+			alt.saveLatencyStats("out/avl_latency.tsv");
+			Profiler<RBtree<string>, getRandomString> rlt;
+			rlt.measureLatency(max_size);
+			rlt.saveLatencyStats("out/rb_latency.tsv");
+			Profiler<BPtree<string>, getRandomString> blt;
+			blt.measureLatency(max_size);
+			blt.saveLatencyStats("out/bp_latency.tsv");
+		}
+		if (load) {
+			Profiler<AVLtree<string>, getRandomString> ald;
+			ald.measureLoad(max_size, "out/avl.bin");
+			ald.saveAllocStats("out/avl_load.tsv");
+			Profiler<RBtree<string>, getRandomString> rld;
+			rld.measureLoad(max_size, "out/rb.bin");
+			rld.saveAllocStats("out/rb_load.tsv");
+		}
+		if (dispatch) {
+			Profiler<AVLtree<string>, getRandomString> adp;
+			adp.measureDispatch(max_size);
+			adp.saveThroughputStats("out/avl_dispatch.tsv");
+			Profiler<RBtree<string>, getRandomString> rdp;
+			rdp.measureDispatch(max_size);
+			rdp.saveThroughputStats("out/rb_dispatch.tsv");
+		}
+		if (persistent) {
+			Profiler<RBtree<string>, getRandomString> rpp;
+			rpp.measurePersistent(max_size);
+			rpp.saveAllocStats("out/rb_persistent.tsv");
+			rpp.saveSnapshotStats("out/persistent_snapshots.tsv");
+		}
+		if (sharded) {
+			Profiler<AVLtree<string>, getRandomString> asp;
+			asp.measureSharded(max_size);
+			asp.saveThroughputStats("out/avl_sharded.tsv");
+			Profiler<RBtree<string>, getRandomString> rsp;
+			rsp.measureSharded(max_size);
+			rsp.saveThroughputStats("out/rb_sharded.tsv");
+		}
+		if (concurrent) {
+			Profiler<AVLtree<string>, getRandomString> acp;
+			acp.measureConcurrent(max_size);
+			acp.saveThroughputStats("out/avl_concurrent.tsv");
+			Profiler<RBtree<string>, getRandomString> rcp;
+			rcp.measureConcurrent(max_size);
+			rcp.saveThroughputStats("out/rb_concurrent.tsv");
+		}
+		if (frozen) {
+			Profiler<AVLtree<string>, getRandomString> afp;
+			afp.measureFrozen(max_size);
+			afp.saveThroughputStats("out/avl_frozen.tsv");
+			Profiler<RBtree<string>, getRandomString> rfp;
+			rfp.measureFrozen(max_size);
+			rfp.saveThroughputStats("out/rb_frozen.tsv");
+		}
+		if (batch) {
+			Profiler<AVLtree<string>, getRandomString> abp;
+			abp.measureBatch(max_size);
+			abp.saveThroughputStats("out/avl_batch.tsv");
+			Profiler<RBtree<string>, getRandomString> rbp;
+			rbp.measureBatch(max_size);
+			rbp.saveThroughputStats("out/rb_batch.tsv");
+		}
+		if (build) {
+			Profiler<AVLtree<string>, getRandomString> abp;
+			abp.measureBuild(max_size);
+			abp.saveAllocStats("out/avl_build.tsv");
+			Profiler<RBtree<string>, getRandomString> rbp;
+			rbp.measureBuild(max_size);
+			rbp.saveAllocStats("out/rb_build.tsv");
+		}
+		if (map) {
+			Profiler<AVLmap<string, string>, getRandomString> amp;
+			amp.measureMap(max_size, map_value_len);
+			amp.saveAllocStats("out/avl_map.tsv");
+			Profiler<RBmap<string, string>, getRandomString> rmp;
+			rmp.measureMap(max_size, map_value_len);
+			rmp.saveAllocStats("out/rb_map.tsv");
+		}
+		if (compare_alloc) {
+			Profiler<AVLtree<string, std::less<string>, std::allocator<string>>, getRandomString> ahp;
+			ahp.measure(max_size);
+			ahp.saveStats("out/avl_heap.tsv");
+			Profiler<RBtree<string, std::less<string>, std::allocator<string>>, getRandomString> rhp;
+			rhp.measure(max_size);
+			rhp.saveStats("out/rb_heap.tsv");
+		}
 	}
 	else {
 		Profiler<AVLtree<int>> ap;
+		Profiler<RBtree<int>> rp;
+		Profiler<BPtree<int>> bp;
+		if (use_counters && !(ap.useCounters() && rp.useCounters() && bp.useCounters()))
+			cerr << "Hardware counters are not available, only the time is measured\n";
 		ap.measure(max_size);
 		ap.saveStats("out/avl.tsv");
-		Profiler<RBtree<int>> rp;
 		rp.measure(max_size);
 		rp.saveStats("out/rb.tsv");
+		bp.measure(max_size);
+		bp.saveStats("out/bp.tsv");
+		if (scan) {
+			ap.measureScan(max_size, scan_lengths);
+			ap.saveScanStats("out/avl_scan.tsv");
+			rp.measureScan(max_size, scan_lengths);
+			rp.saveScanStats("out/rb_scan.tsv");
+			bp.measureScan(max_size, scan_lengths);
+			bp.saveScanStats("out/bp_scan.tsv");
+		}
+		if (merge) {
+			Profiler<AVLtree<int>> aup;
+			aup.measureUnion(max_size);
+			aup.saveAllocStats("out/avl_union.tsv");
+			Profiler<RBtree<int>> rup;
+			rup.measureUnion(max_size);
+			rup.saveAllocStats("out/rb_union.tsv");
+		}
+		if (!replay_path.empty()) {
+			Profiler<AVLtree<int>> arp;
+			arp.measureReplay(replay_path);
+			arp.saveThroughputStats("out/avl_replay.tsv");
+			arp.saveLatencyStats("out/avl_replay_latency.tsv");
+			Profiler<RBtree<int>> rrp;
+			rrp.measureReplay(replay_path);
+			rrp.saveThroughputStats("out/rb_replay.tsv");
+			rrp.saveLatencyStats("out/rb_replay_latency.tsv");
+			Profiler<BPtree<int>> brp;
+			brp.measureReplay(replay_path);
+			brp.saveThroughputStats("out/bp_replay.tsv");
+			brp.saveLatencyStats("out/bp_replay_latency.tsv");
+		}
+		if (workload) {
+			if (!record_path.empty())
+				saveWorkload(record_path, Workload<int>(config));
+			Profiler<AVLtree<int>> awp;
+			awp.measureWorkload(config);
+			awp.saveThroughputStats("out/avl_workload.tsv");
+			Profiler<RBtree<int>> rwp;
+			rwp.measureWorkload(config);
+			rwp.saveThroughputStats("out/rb_workload.tsv");
+			Profiler<BPtree<int>> bwp;
+			bwp.measureWorkload(config);
+			bwp.saveThroughputStats("out/bp_workload.tsv");
+		}
+		if (latency) {
+			Profiler<AVLtree<int>> alt;
+			alt.measureLatency(max_size);
+			alt.saveLatencyStats("out/avl_latency.tsv");
+			Profiler<RBtree<int>> rlt;
+			rlt.measureLatency(max_size);
+			rlt.saveLatencyStats("out/rb_latency.tsv");
+			Profiler<BPtree<int>> blt;
+			blt.measureLatency(max_size);
+			blt.saveLatencyStats("out/bp_latency.tsv");
+		}
+		if (load) {
+			Profiler<AVLtree<int>> ald;
+			ald.measureLoad(max_size, "out/avl.bin");
+			ald.saveAllocStats("out/avl_load.tsv");
+			Profiler<RBtree<int>> rld;
+			rld.measureLoad(max_size, "out/rb.bin");
+			rld.saveAllocStats("out/rb_load.tsv");
+		}
+		if (dispatch) {
+			Profiler<AVLtree<int>> adp;
+			adp.measureDispatch(max_size);
+			adp.saveThroughputStats("out/avl_dispatch.tsv");
+			Profiler<RBtree<int>> rdp;
+			rdp.measureDispatch(max_size);
+			rdp.saveThroughputStats("out/rb_dispatch.tsv");
+		}
+		if (persistent) {
+			Profiler<RBtree<int>> rpp;
+			rpp.measurePersistent(max_size);
+			rpp.saveAllocStats("out/rb_persistent.tsv");
+			rpp.saveSnapshotStats("out/persistent_snapshots.tsv");
+		}
+		if (sharded) {
+			Profiler<AVLtree<int>> asp;
+			asp.measureSharded(max_size);
+			asp.saveThroughputStats("out/avl_sharded.tsv");
+			Profiler<RBtree<int>> rsp;
+			rsp.measureSharded(max_size);
+			rsp.saveThroughputStats("out/rb_sharded.tsv");
+		}
+		if (concurrent) {
+			Profiler<AVLtree<int>> acp;
+			acp.measureConcurrent(max_size);
+			acp.saveThroughputStats("out/avl_concurrent.tsv");
+			Profiler<RBtree<int>> rcp;
+			rcp.measureConcurrent(max_size);
+			rcp.saveThroughputStats("out/rb_concurrent.tsv");
+		}
+		if (frozen) {
+			Profiler<AVLtree<int>> afp;
+			afp.measureFrozen(max_size);
+			afp.saveThroughputStats("out/avl_frozen.tsv");
+			Profiler<RBtree<int>> rfp;
+			rfp.measureFrozen(max_size);
+			rfp.saveThroughputStats("out/rb_frozen.tsv");
+		}
+		if (batch) {
+			Profiler<AVLtree<int>> abp;
+			abp.measureBatch(max_size);
+			abp.saveThroughputStats("out/avl_batch.tsv");
+			Profiler<RBtree<int>> rbp;
+			rbp.measureBatch(max_size);
+			rbp.saveThroughputStats("out/rb_batch.tsv");
+		}
+		if (build) {
+			Profiler<AVLtree<int>> abp;
+			abp.measureBuild(max_size);
+			abp.saveAllocStats("out/avl_build.tsv");
+			Profiler<RBtree<int>> rbp;
+			rbp.measureBuild(max_size);
+			rbp.saveAllocStats("out/rb_build.tsv");
+		}
+		if (map) {
+			Profiler<AVLmap<int, string>> amp;
+			amp.measureMap(max_size, map_value_len);
+			amp.saveAllocStats("out/avl_map.tsv");
+			Profiler<RBmap<int, string>> rmp;
+			rmp.measureMap(max_size, map_value_len);
+			rmp.saveAllocStats("out/rb_map.tsv");
+		}
+		if (compare_alloc) {
+			Profiler<AVLtree<int, std::less<int>, std::allocator<int>>> ahp;
+			ahp.measure(max_size);
+			ahp.saveStats("out/avl_heap.tsv");
+			Profiler<RBtree<int, std::less<int>, std::allocator<int>>> rhp;
+			rhp.measure(max_size);
+			rhp.saveStats("out/rb_heap.tsv");
+		}
 	}
 	return 0;
 }
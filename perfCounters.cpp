@@ -0,0 +1,95 @@
+/*
+ * Hardware counters through perf_event_open. Every counter is opened on
+ * its own, so the ones the CPU or the kernel settings do not allow are
+ * just skipped. The counts are scaled when the kernel multiplexes them.
+ */
+#include "perfCounters.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdint>
+
+static std::uint64_t cacheMiss(std::uint64_t cache)
+{
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+static const struct {
+    const char *name;
+    std::uint32_t type;
+    std::uint64_t config;
+} events[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"l1d_misses", PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D)},
+    {"llc_misses", PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_LL)},
+    {"dtlb_misses", PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_DTLB)},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+PerfCounters::PerfCounters()
+{
+    for (auto &e : events) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = e.type;
+        attr.config = e.config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd >= 0) {
+            fds.push_back(fd);
+            opened.push_back(e.name);
+        }
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int fd : fds)
+        close(fd);
+}
+
+void PerfCounters::start()
+{
+    for (int fd : fds) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+std::vector<double> PerfCounters::stop()
+{
+    for (int fd : fds)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    std::vector<double> res;
+    for (int fd : fds) {
+        std::uint64_t data[3] = {0, 0, 0}; /* value, time enabled, time running */
+        if (read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            res.push_back(0);
+        else
+            res.push_back((double)data[0] * data[1] / data[2]);
+    }
+    return res;
+}
+
+#else
+
+PerfCounters::PerfCounters() {}
+PerfCounters::~PerfCounters() {}
+void PerfCounters::start() {}
+std::vector<double> PerfCounters::stop() { return {}; }
+
+#endif
+
+const std::vector<std::string> &PerfCounters::names() const
+{
+    return opened;
+}
@@ -0,0 +1,31 @@
+#ifndef PERFCOUNTERS_HPP
+#define PERFCOUNTERS_HPP
+
+#include <vector>
+#include <string>
+
+/**
+ * Hardware counters of the calling thread (cycles, instructions, cache,
+ * TLB and branch misses) read through perf_event_open on Linux. Counters
+ * which cannot be opened are left out, on other systems all of them.
+ */
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    /* The names of the counters which work */
+    const std::vector<std::string> &names() const;
+    void start();
+    /* The counts since start(), in the order of names() */
+    std::vector<double> stop();
+
+private:
+    std::vector<int> fds;
+    std::vector<std::string> opened;
+};
+
+#endif /* PERFCOUNTERS_HPP */